@@ -1,68 +1,78 @@
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <regex>
 #include <mutex>
 
 #include "impala_udf/udf.h"
+#include "MaskEngine.h"
 
 using namespace impala_udf;
 
 class RegexCache {
 public:
-    static const std::regex* GetRegex(const std::string& key) {
+    // 키 바이트를 그 자리에서 완전 해시로 찾으므로 행마다 키 문자열을 만들지 않습니다.
+    // 규칙 파일을 파싱하지 못하면 context에 오류를 남기고 nullptr을 반환합니다.
+    static const CompiledRule* GetRegex(FunctionContext* context, const char* key, size_t len) {
         std::lock_guard<std::mutex> lock(mutex_);
-        auto it = regex_map_.find(key);
-        if (it != regex_map_.end()) return it->second.get();
-
-        auto regex_str_it = regex_patterns_.find(key);
-        if (regex_str_it == regex_patterns_.end()) return nullptr;
+        if (!patterns_loaded_) {
+            std::string error;
+            if (!LoadPatterns(&error)) {
+                context->SetError(error.c_str());
+                return nullptr;
+            }
+        }
+        int id = rule_index_.Find(key, len);
+        if (id < 0) return nullptr;
+        if (regex_map_[id]) return regex_map_[id].get();
+        if (failed_[id]) return nullptr;
 
-        try {
-            std::unique_ptr<std::regex> compiled(new std::regex(regex_str_it->second));
-            const std::regex* ptr = compiled.get();
-            regex_map_[key] = std::move(compiled);
-            return ptr;
-        } catch (const std::regex_error&) {
+        std::string error;
+        std::unique_ptr<CompiledRule> compiled = CompileMaskRule(regex_patterns_[id], &error);
+        if (!compiled) {
+            // 실패한 규칙은 행마다 잠금 아래에서 다시 컴파일하지 않도록 기억해 둡니다.
+            failed_[id] = true;
             return nullptr;
         }
+        compiled->id = id;
+        regex_map_[id] = std::move(compiled);
+        return regex_map_[id].get();
     }
 
 private:
-    static inline std::unordered_map<std::string, std::string> regex_patterns_ = {
-        {"APN", R"(\d{4})"},
-        {"EMAIL", R"([a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,})"},
-        {"SSN", R"(\d{6}-\d{7})"}
-    };
+    // 파싱에 실패하면 규칙 표를 비워 두지 않고 로드하지 않은 상태로 남겨, 파일을 고친 뒤의 쿼리가 다시 읽게 합니다.
+    static bool LoadPatterns(std::string* error) {
+        std::vector<MaskRuleSpec> specs;
+        if (!LoadMaskRules(MaskRulesPath(), &specs, error)) return false;
+        DedupMaskRules(&specs);
+        regex_patterns_ = std::move(specs);
+        rule_index_.Build(regex_patterns_);
+        regex_map_.resize(regex_patterns_.size());
+        failed_.assign(regex_patterns_.size(), false);
+        patterns_loaded_ = true;
+        return true;
+    }
+
+    // 규칙 id(regex_patterns_의 인덱스)별 규칙과 컴파일된 규칙, 컴파일에 실패한 규칙
+    static inline std::vector<MaskRuleSpec> regex_patterns_;
+    static inline MaskRuleIndex rule_index_;
+    static inline bool patterns_loaded_ = false;
 
-    static inline std::unordered_map<std::string, std::unique_ptr<std::regex>> regex_map_;
+    static inline std::vector<std::unique_ptr<CompiledRule>> regex_map_;
+    static inline std::vector<bool> failed_;
     static inline std::mutex mutex_;
 };
 
 StringVal mask(FunctionContext* context, const StringVal& key, const StringVal& input) {
     if (key.is_null || input.is_null) return StringVal::null();
 
-    std::string key_str(reinterpret_cast<const char*>(key.ptr), key.len);
-    std::string input_str(reinterpret_cast<const char*>(input.ptr), input.len);
-
-    const std::regex* pattern = RegexCache::GetRegex(key_str);
+    const CompiledRule* pattern = RegexCache::GetRegex(context, reinterpret_cast<const char*>(key.ptr), key.len);
     if (!pattern) return StringVal::null(); // Unknown key
 
-    std::string result;
-    std::sregex_iterator it(input_str.begin(), input_str.end(), *pattern);
-    std::sregex_iterator end;
-
-    size_t last = 0;
-    for (; it != end; ++it) {
-        result.append(input_str, last, it->position() - last);
-        result.append(it->length(), '*');
-        last = it->position() + it->length();
-    }
-    result.append(input_str.substr(last));
-
-    StringVal out(context->Allocate(result.size()));
-    if (out.ptr == nullptr) return StringVal::null();
+    StringVal out(context->Allocate(input.len));
+    if (out.ptr == nullptr && input.len != 0) return StringVal::null();
 
-    memcpy(out.ptr, result.data(), result.size());
-    out.len = result.size();
+    MaskIntoWith(*pattern, reinterpret_cast<const char*>(input.ptr), input.len, reinterpret_cast<char*>(out.ptr),
+                 ConstByteFill<'*'>());
+    out.len = input.len;
     return out;
 }
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "MaskEngine.h"
+#include "MaskStats.h"
+
+// mask()의 규칙별 적응 제어.
+//
+// 스레드마다 규칙마다 하나씩 두고, kMaskAdaptWindow행마다 그 창에서 관찰한 통계로 다음 창의 MaskScanOptions를
+// 정합니다. 어느 조합이든 매치 결과는 같고 비용만 달라집니다.
+//
+//   prefilter  사전 필터로 건너뛴 행이 창의 1/8 미만이면 끕니다. 모든 행에 필수 바이트나 인자 리터럴이 있는
+//              열에서는 memchr나 리터럴 검색 한 번이 그대로 추가 비용이기 때문입니다.
+//   memo       실패한 경로와 만나 일찍 멈춘 시도가 시도의 1/64 미만이면 끕니다. 바이트마다의 경로 기록을 아낍니다.
+//   simd       시도마다 첫 바이트 검색이 건너뛴 바이트가 평균 kMaskAdaptMinSkip 미만이면 (시작 후보가 촘촘하면)
+//              SIMD 커널 대신 스칼라 루프를 씁니다.
+//
+// 꺼진 prefilter와 memo는 효과를 관찰할 수 없으므로 kMaskAdaptProbe창마다 한 창 다시 켜 보고 판단합니다.
+// simd의 통계는 어느 쪽에서나 세므로 창마다 다시 정합니다. 행마다 드는 비용은 카운터 몇 개를 더하는 것이며,
+// 시각을 읽지 않고 행이 실제로 건너뛰거나 읽은 양을 비용으로 봅니다.
+// 결정은 규칙 카운터(adapt_windows, *_off_windows)에 창 단위로 남습니다.
+
+constexpr uint64_t kMaskAdaptWindow = 1024;
+constexpr uint64_t kMaskAdaptProbe = 16;
+constexpr size_t kMaskAdaptMinSkip = 8;
+
+// IMPALA_MASK_ADAPT=0이면 적응 제어를 끄고 모든 기능을 켠 채로 실행합니다.
+inline bool MaskAdaptEnabled() {
+    const char* env = std::getenv("IMPALA_MASK_ADAPT");
+    return env == nullptr || strcmp(env, "0") != 0;
+}
+
+class MaskAdaptive {
+public:
+    const MaskScanOptions& options() const { return options_; }
+
+    // 한 행의 결과를 더하고, 창이 차면 다음 창의 기능을 정해 counters에 남깁니다.
+    void Record(const CompiledRule& rule, const MaskScanResult& scan, MaskRuleCounters* counters) {
+        ++rows_;
+        if (scan.prefiltered) ++skipped_rows_;
+        attempts_ += scan.stream.attempts;
+        memo_stops_ += scan.stream.memo_stops;
+        skipped_bytes_ += scan.stream.skipped;
+        if (rows_ == kMaskAdaptWindow) Decide(rule, counters);
+    }
+
+private:
+    void Decide(const CompiledRule& rule, MaskRuleCounters* counters) {
+        ++counters->adapt_windows;
+        if (!options_.prefilter) ++counters->prefilter_off_windows;
+        if (!options_.memo) ++counters->memo_off_windows;
+        if (!options_.simd) ++counters->simd_off_windows;
+
+        // 사전 필터가 없는 규칙과 시도가 없던 창(std::regex, 리터럴)은 판단하지 않습니다.
+        if (options_.prefilter && MaskHasPrefilter(rule)) prefilter_useful_ = skipped_rows_ * 8 >= rows_;
+        if (attempts_ > 0) {
+            if (options_.memo) memo_useful_ = memo_stops_ * 64 >= attempts_;
+            options_.simd = skipped_bytes_ >= attempts_ * kMaskAdaptMinSkip;
+        }
+        bool probe = ++windows_ % kMaskAdaptProbe == 0;
+        options_.prefilter = prefilter_useful_ || probe;
+        options_.memo = memo_useful_ || probe;
+
+        rows_ = 0;
+        skipped_rows_ = 0;
+        attempts_ = 0;
+        memo_stops_ = 0;
+        skipped_bytes_ = 0;
+    }
+
+    MaskScanOptions options_;
+    bool prefilter_useful_ = true;
+    bool memo_useful_ = true;
+    uint64_t windows_ = 0;
+
+    // 현재 창의 통계
+    uint64_t rows_ = 0;
+    uint64_t skipped_rows_ = 0;
+    uint64_t attempts_ = 0;
+    uint64_t memo_stops_ = 0;
+    uint64_t skipped_bytes_ = 0;
+};
+
+// 규칙 id로 인덱싱하는 적응 제어 목록 (스레드별)
+struct MaskAdaptiveTable {
+    std::vector<MaskAdaptive> by_rule;
+
+    MaskAdaptive& For(int rule_id) {
+        if (static_cast<size_t>(rule_id) >= by_rule.size()) by_rule.resize(rule_id + 1);
+        return by_rule[rule_id];
+    }
+};
@@ -0,0 +1,877 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MaskSimd.h"
+
+// 마스킹 규칙용 바이트 단위 정규식 → DFA 컴파일러와 스트리밍 매처.
+//
+// ECMAScript 문법 중 마스킹 규칙에 쓰이는 부분(문자, 문자 클래스, ., 그룹, |, *, +, ?, {n,m})만 지원하고,
+// 앵커·전후방 탐색·역참조·게으른 수량자가 있는 패턴은 컴파일하지 않습니다(std::regex로 처리).
+// 매칭은 POSIX처럼 가장 왼쪽에서 시작하는 가장 긴 매치(leftmost-longest)를 찾습니다. 이는 ECMAScript의 첫 대안 우선
+// (백트래킹) 의미와 일부러 다르게 정한 것으로, 대안(`a|ab`)뿐 아니라 선택적 부분(`a?(?:ab)?`)이나 더 긴 매치가 뒤의
+// 대안에 있는 경우(`\d{4}|\d{4}-\d{2}`)에도 std::regex보다 길게 매치할 수 있습니다. MaskTest.cc가 std::regex로
+// 구한 가장 긴 매치와 비교합니다.
+
+// 256비트 바이트 집합
+struct ByteSet {
+    uint64_t bits[4] = {0, 0, 0, 0};
+
+    void Set(uint8_t b) { bits[b >> 6] |= uint64_t{1} << (b & 63); }
+    bool Has(uint8_t b) const { return (bits[b >> 6] >> (b & 63)) & 1; }
+    void SetRange(uint8_t lo, uint8_t hi) {
+        for (int b = lo; b <= hi; ++b) Set(static_cast<uint8_t>(b));
+    }
+    void Add(const ByteSet& other) {
+        for (int i = 0; i < 4; ++i) bits[i] |= other.bits[i];
+    }
+    void Invert() {
+        for (int i = 0; i < 4; ++i) bits[i] = ~bits[i];
+    }
+};
+
+// 정규식 구문 트리
+struct RegexNode {
+    enum Kind { kEmpty, kSet, kConcat, kAlternate, kRepeat };
+    Kind kind = kEmpty;
+    ByteSet set;
+    std::vector<std::unique_ptr<RegexNode>> children;
+    int min = 0;
+    int max = -1;  // -1이면 상한 없음
+};
+
+// 수량자 {n,m}에 허용하는 최대 반복 횟수
+constexpr int kMaxRegexRepeat = 1000;
+
+class RegexParser {
+public:
+    explicit RegexParser(const std::string& pattern) : p_(pattern) {}
+
+    // 지원하지 않는 문법이면 nullptr을 반환하고 reason에 원인을 담습니다.
+    std::unique_ptr<RegexNode> Parse(std::string* reason) {
+        std::unique_ptr<RegexNode> node = ParseAlternate();
+        if (node != nullptr && pos_ != p_.size()) Fail("unbalanced ')'");
+        if (!error_.empty()) {
+            *reason = error_;
+            return nullptr;
+        }
+        return node;
+    }
+
+private:
+    bool AtEnd() const { return pos_ >= p_.size(); }
+    char Peek() const { return p_[pos_]; }
+
+    std::unique_ptr<RegexNode> Fail(const std::string& why) {
+        if (error_.empty()) error_ = why;
+        return nullptr;
+    }
+
+    static std::unique_ptr<RegexNode> MakeSet(const ByteSet& set) {
+        std::unique_ptr<RegexNode> node(new RegexNode());
+        node->kind = RegexNode::kSet;
+        node->set = set;
+        return node;
+    }
+
+    std::unique_ptr<RegexNode> ParseAlternate() {
+        std::unique_ptr<RegexNode> first = ParseConcat();
+        if (first == nullptr || AtEnd() || Peek() != '|') return first;
+        std::unique_ptr<RegexNode> alt(new RegexNode());
+        alt->kind = RegexNode::kAlternate;
+        alt->children.push_back(std::move(first));
+        while (!AtEnd() && Peek() == '|') {
+            ++pos_;
+            std::unique_ptr<RegexNode> next = ParseConcat();
+            if (next == nullptr) return nullptr;
+            alt->children.push_back(std::move(next));
+        }
+        return alt;
+    }
+
+    std::unique_ptr<RegexNode> ParseConcat() {
+        std::unique_ptr<RegexNode> concat(new RegexNode());
+        concat->kind = RegexNode::kConcat;
+        while (!AtEnd() && Peek() != '|' && Peek() != ')') {
+            std::unique_ptr<RegexNode> item = ParseRepeat();
+            if (item == nullptr) return nullptr;
+            concat->children.push_back(std::move(item));
+        }
+        return concat;
+    }
+
+    bool ParseNumber(int* value) {
+        size_t start = pos_;
+        long v = 0;
+        while (!AtEnd() && Peek() >= '0' && Peek() <= '9') {
+            v = v * 10 + (Peek() - '0');
+            if (v > kMaxRegexRepeat) return false;
+            ++pos_;
+        }
+        *value = static_cast<int>(v);
+        return pos_ != start;
+    }
+
+    std::unique_ptr<RegexNode> ParseRepeat() {
+        std::unique_ptr<RegexNode> atom = ParseAtom();
+        if (atom == nullptr) return nullptr;
+        while (!AtEnd()) {
+            int min;
+            int max;
+            char c = Peek();
+            if (c == '*') {
+                min = 0;
+                max = -1;
+                ++pos_;
+            } else if (c == '+') {
+                min = 1;
+                max = -1;
+                ++pos_;
+            } else if (c == '?') {
+                min = 0;
+                max = 1;
+                ++pos_;
+            } else if (c == '{') {
+                size_t save = pos_++;
+                if (!ParseNumber(&min)) {
+                    // 수량자가 아닌 `{`는 std::regex에 맡깁니다.
+                    pos_ = save;
+                    return Fail("unsupported '{'");
+                }
+                max = min;
+                if (!AtEnd() && Peek() == ',') {
+                    ++pos_;
+                    max = -1;
+                    if (!AtEnd() && Peek() != '}' && !ParseNumber(&max)) return Fail("bad repeat count");
+                }
+                if (AtEnd() || Peek() != '}') return Fail("bad repeat count");
+                ++pos_;
+                if (max != -1 && max < min) return Fail("bad repeat range");
+            } else {
+                break;
+            }
+            if (!AtEnd() && Peek() == '?') return Fail("lazy quantifier");
+            std::unique_ptr<RegexNode> repeat(new RegexNode());
+            repeat->kind = RegexNode::kRepeat;
+            repeat->min = min;
+            repeat->max = max;
+            repeat->children.push_back(std::move(atom));
+            atom = std::move(repeat);
+        }
+        return atom;
+    }
+
+    std::unique_ptr<RegexNode> ParseAtom() {
+        char c = Peek();
+        if (c == '(') {
+            ++pos_;
+            if (!AtEnd() && Peek() == '?') {
+                if (pos_ + 1 < p_.size() && p_[pos_ + 1] == ':') {
+                    pos_ += 2;
+                } else {
+                    return Fail("lookaround");
+                }
+            }
+            std::unique_ptr<RegexNode> inner = ParseAlternate();
+            if (inner == nullptr) return nullptr;
+            if (AtEnd() || Peek() != ')') return Fail("missing ')'");
+            ++pos_;
+            return inner;
+        }
+        if (c == '[') return ParseClass();
+        if (c == '^' || c == '$') return Fail("anchor");
+        if (c == '*' || c == '+' || c == '?' || c == '{' || c == '}' || c == ']') return Fail("unexpected quantifier");
+        ++pos_;
+        ByteSet set;
+        if (c == '.') {
+            set.Invert();
+            set.bits[0] &= ~((uint64_t{1} << '\n') | (uint64_t{1} << '\r'));
+        } else if (c == '\\') {
+            if (!ParseEscape(&set)) return nullptr;
+        } else {
+            set.Set(static_cast<uint8_t>(c));
+        }
+        return MakeSet(set);
+    }
+
+    // `\` 다음의 이스케이프를 set에 추가합니다. single에는 단일 바이트 이스케이프인지 돌려줍니다.
+    bool ParseEscape(ByteSet* set, int* single = nullptr) {
+        if (AtEnd()) {
+            Fail("trailing '\\'");
+            return false;
+        }
+        char c = p_[pos_++];
+        ByteSet cls;
+        int byte = -1;
+        switch (c) {
+            case 'd': case 'D':
+                cls.SetRange('0', '9');
+                break;
+            case 'w': case 'W':
+                cls.SetRange('a', 'z');
+                cls.SetRange('A', 'Z');
+                cls.SetRange('0', '9');
+                cls.Set('_');
+                break;
+            case 's': case 'S':
+                for (char ws : {' ', '\t', '\n', '\v', '\f', '\r'}) cls.Set(static_cast<uint8_t>(ws));
+                break;
+            case 'n': byte = '\n'; break;
+            case 't': byte = '\t'; break;
+            case 'r': byte = '\r'; break;
+            case 'f': byte = '\f'; break;
+            case 'v': byte = '\v'; break;
+            case '0': byte = 0; break;
+            case 'x': case 'u': {
+                int digits = c == 'x' ? 2 : 4;
+                int value = 0;
+                for (int i = 0; i < digits; ++i) {
+                    int h = AtEnd() ? -1 : HexDigit(p_[pos_]);
+                    if (h < 0) {
+                        Fail("bad hex escape");
+                        return false;
+                    }
+                    value = value * 16 + h;
+                    ++pos_;
+                }
+                if (value > 0x7f) {
+                    Fail("non-ASCII code point escape");
+                    return false;
+                }
+                byte = value;
+                break;
+            }
+            default:
+                if ((c >= '1' && c <= '9') || c == 'b' || c == 'B' || c == 'c' || c == 'k') {
+                    Fail(std::string("unsupported escape \\") + c);
+                    return false;
+                }
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+                    Fail(std::string("unknown escape \\") + c);
+                    return false;
+                }
+                byte = static_cast<uint8_t>(c);
+                break;
+        }
+        if (byte >= 0) {
+            set->Set(static_cast<uint8_t>(byte));
+            if (single != nullptr) *single = byte;
+            return true;
+        }
+        if (c == 'D' || c == 'W' || c == 'S') cls.Invert();
+        set->Add(cls);
+        if (single != nullptr) *single = -1;
+        return true;
+    }
+
+    static int HexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    std::unique_ptr<RegexNode> ParseClass() {
+        ++pos_;  // '['
+        bool negate = false;
+        if (!AtEnd() && Peek() == '^') {
+            negate = true;
+            ++pos_;
+        }
+        ByteSet set;
+        bool first = true;
+        while (true) {
+            if (AtEnd()) return Fail("missing ']'");
+            char c = Peek();
+            if (c == ']' && !first) break;
+            if (c == ']') return Fail("empty class");
+            first = false;
+            ++pos_;
+
+            int lo;
+            if (c == '\\') {
+                if (!ParseEscape(&set, &lo)) return nullptr;
+            } else if (c == '[') {
+                return Fail("unsupported class syntax");
+            } else {
+                lo = static_cast<uint8_t>(c);
+                set.Set(static_cast<uint8_t>(lo));
+            }
+
+            // 범위 a-z. 마지막 '-'나 클래스 이스케이프 뒤의 '-'는 문자입니다.
+            if (!AtEnd() && Peek() == '-' && pos_ + 1 < p_.size() && p_[pos_ + 1] != ']') {
+                if (lo < 0) return Fail("class escape in range");
+                ++pos_;
+                int hi;
+                char h = p_[pos_++];
+                if (h == '\\') {
+                    ByteSet ignored;
+                    if (!ParseEscape(&ignored, &hi)) return nullptr;
+                    if (hi < 0) return Fail("class escape in range");
+                } else {
+                    hi = static_cast<uint8_t>(h);
+                }
+                if (hi < lo) return Fail("bad class range");
+                set.SetRange(static_cast<uint8_t>(lo), static_cast<uint8_t>(hi));
+            }
+        }
+        ++pos_;  // ']'
+        if (negate) set.Invert();
+        return MakeSet(set);
+    }
+
+    const std::string& p_;
+    size_t pos_ = 0;
+    std::string error_;
+};
+
+// Thompson NFA. 각 상태는 바이트 집합 전이 하나와 엡실론 전이 목록을 가집니다.
+struct NfaState {
+    ByteSet set;
+    int next = -1;  // set에 속한 바이트를 읽으면 가는 상태 (-1이면 없음)
+    std::vector<int> eps;
+};
+
+// NFA 상태 수 상한. 큰 {n,m} 반복이 메모리를 과도하게 쓰지 않도록 합니다.
+constexpr size_t kMaxNfaStates = 20000;
+
+class NfaBuilder {
+public:
+    std::vector<NfaState> states;
+
+    struct Frag {
+        int start;
+        int end;
+    };
+
+    // 실패하면 start가 -1인 Frag를 반환합니다.
+    Frag Build(const RegexNode& node) {
+        if (states.size() > kMaxNfaStates) return {-1, -1};
+        switch (node.kind) {
+            case RegexNode::kEmpty: {
+                int s = NewState();
+                return {s, s};
+            }
+            case RegexNode::kSet: {
+                int s = NewState();
+                int e = NewState();
+                states[s].set = node.set;
+                states[s].next = e;
+                return {s, e};
+            }
+            case RegexNode::kConcat: {
+                int s = NewState();
+                int cur = s;
+                for (const auto& child : node.children) {
+                    Frag f = Build(*child);
+                    if (f.start < 0) return f;
+                    states[cur].eps.push_back(f.start);
+                    cur = f.end;
+                }
+                return {s, cur};
+            }
+            case RegexNode::kAlternate: {
+                int s = NewState();
+                int e = NewState();
+                for (const auto& child : node.children) {
+                    Frag f = Build(*child);
+                    if (f.start < 0) return f;
+                    states[s].eps.push_back(f.start);
+                    states[f.end].eps.push_back(e);
+                }
+                return {s, e};
+            }
+            case RegexNode::kRepeat: {
+                const RegexNode& child = *node.children[0];
+                int s = NewState();
+                int cur = s;
+                for (int i = 0; i < node.min; ++i) {
+                    Frag f = Build(child);
+                    if (f.start < 0) return f;
+                    states[cur].eps.push_back(f.start);
+                    cur = f.end;
+                }
+                int e = NewState();
+                if (node.max < 0) {
+                    // 상한이 없으면 한 번 더 만든 조각을 루프로 연결합니다.
+                    Frag f = Build(child);
+                    if (f.start < 0) return f;
+                    states[cur].eps.push_back(f.start);
+                    states[cur].eps.push_back(e);
+                    states[f.end].eps.push_back(cur);
+                } else {
+                    for (int i = node.min; i < node.max; ++i) {
+                        Frag f = Build(child);
+                        if (f.start < 0) return f;
+                        states[cur].eps.push_back(f.start);
+                        states[cur].eps.push_back(e);
+                        cur = f.end;
+                    }
+                    states[cur].eps.push_back(e);
+                }
+                return {s, e};
+            }
+        }
+        return {-1, -1};
+    }
+
+private:
+    int NewState() {
+        states.emplace_back();
+        return static_cast<int>(states.size()) - 1;
+    }
+};
+
+// DFA 상태 수 상한. 넘으면 std::regex로 처리합니다.
+constexpr int kMaxDfaStates = 4096;
+
+// DFA 표의 형식 번호. 표의 배치가 바뀌면 올리고 MaskBuiltinRules.inc를 다시 생성합니다.
+constexpr int kMaskDfaFormat = 2;
+
+// 이 크기 이상의 DFA 표는 mmap으로 잡아 투명 huge page를 요청합니다 (IMPALA_MASK_HUGEPAGES=0이면 끔).
+constexpr size_t kMaskHugePageBytes = size_t{2} << 20;
+
+inline bool MaskHugePagesEnabled() {
+    const char* env = std::getenv("IMPALA_MASK_HUGEPAGES");
+    return env == nullptr || strcmp(env, "0") != 0;
+}
+
+// 64바이트(캐시 라인) 경계에 놓이는 연속된 int32 표. 크면 huge page를 요청합니다.
+class MaskTableStorage {
+public:
+    MaskTableStorage() = default;
+    MaskTableStorage(const MaskTableStorage&) = delete;
+    MaskTableStorage& operator=(const MaskTableStorage&) = delete;
+    ~MaskTableStorage() { Release(); }
+
+    // 0으로 채운 count개 항목을 잡습니다. 실패하면 nullptr을 반환합니다.
+    int32_t* Allocate(size_t count) {
+        Release();
+        size_t bytes = std::max<size_t>(count * sizeof(int32_t), 64);
+        void* p = nullptr;
+        if (bytes >= kMaskHugePageBytes && MaskHugePagesEnabled()) {
+            bytes = (bytes + kMaskHugePageBytes - 1) & ~(kMaskHugePageBytes - 1);
+            p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                p = nullptr;
+            } else {
+#ifdef MADV_HUGEPAGE
+                madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+                mapped_ = true;
+            }
+        }
+        if (p == nullptr) {
+            bytes = (bytes + 63) & ~size_t{63};
+            p = std::aligned_alloc(64, bytes);
+            if (p == nullptr) return nullptr;
+            memset(p, 0, bytes);
+        }
+        data_ = static_cast<int32_t*>(p);
+        bytes_ = bytes;
+        return data_;
+    }
+
+    const int32_t* data() const { return data_; }
+    size_t bytes() const { return bytes_; }
+    bool huge() const { return mapped_; }
+
+private:
+    void Release() {
+        if (data_ == nullptr) return;
+        if (mapped_) {
+            munmap(data_, bytes_);
+        } else {
+            std::free(data_);
+        }
+        data_ = nullptr;
+        bytes_ = 0;
+        mapped_ = false;
+    }
+
+    int32_t* data_ = nullptr;
+    size_t bytes_ = 0;
+    bool mapped_ = false;
+};
+
+// 앵커가 걸린(시작 위치 고정) DFA.
+//
+// 바이트는 먼저 classes[]로 바이트 클래스(모든 상태에서 같은 전이를 갖는 바이트의 묶음)가 되고, 상태 s의 행은
+// next[s + class]입니다. 상태 번호는 행의 시작 위치(상태 순번 << stride_shift)로 미리 곱해 두었으므로 전이는
+// 클래스 표와 전이 표를 한 번씩 읽는 것이 전부입니다. 한 행의 폭(1 << stride_shift)은 클래스 수 이상의 2의
+// 거듭제곱이며, `\d{6}-\d{7}`은 3개 클래스로 행이 16바이트입니다.
+//
+// 상태 0은 죽은 상태이고, 수락 상태는 표의 뒤쪽에 모아 두어 s >= accept_from이면 수락입니다.
+// 표는 런타임에 컴파일한 경우 storage와 class_storage를, 내장 규칙이면 공유 라이브러리의 읽기 전용 표를 가리킵니다.
+struct MaskDfa {
+    // MaskMatchStream이 쓰는 상태 형식. 경로 기록도 미리 곱한 상태 번호를 그대로 담습니다.
+    using State = int32_t;
+    using TraceState = uint32_t;
+    static constexpr size_t kTrace = 2048;
+
+    int num_states = 0;
+    int num_classes = 0;
+    int stride_shift = 0;
+    int32_t start = 0;
+    int32_t accept_from = 0;
+    const uint8_t* classes = nullptr;  // 256
+    const int32_t* next = nullptr;     // num_states << stride_shift, 64바이트 정렬
+    bool first[256];                   // 시작 상태에서 죽지 않는 첫 바이트
+    ByteSetFinder first_finder;        // first 집합의 SIMD 검색 표
+
+    MaskTableStorage storage;
+    uint8_t class_storage[256];
+
+    MaskDfa() = default;
+    MaskDfa(const MaskDfa&) = delete;
+    MaskDfa& operator=(const MaskDfa&) = delete;
+
+    // 이미 만들어진 표를 가리키게 하고 first를 계산합니다.
+    void Attach(int states, int class_count, int shift, int32_t start_state, int32_t accept_state,
+                const uint8_t* class_table, const int32_t* next_table) {
+        num_states = states;
+        num_classes = class_count;
+        stride_shift = shift;
+        start = start_state;
+        accept_from = accept_state;
+        classes = class_table;
+        next = next_table;
+        for (int b = 0; b < 256; ++b) first[b] = Step(start, static_cast<uint8_t>(b)) != 0;
+        first_finder.Build(first);
+    }
+
+    // 전이 표의 크기 (바이트)
+    size_t TableBytes() const { return (static_cast<size_t>(num_states) << stride_shift) * sizeof(int32_t); }
+
+    State Start() const { return start; }
+    State Step(State s, uint8_t c) const { return next[s + classes[c]]; }
+    bool Accepts(State s) const { return s >= accept_from; }
+};
+
+inline void NfaClosure(const std::vector<NfaState>& nfa, std::vector<int>* set, std::vector<uint8_t>* mark) {
+    std::vector<int> stack(set->begin(), set->end());
+    for (int s : *set) (*mark)[s] = 1;
+    while (!stack.empty()) {
+        int s = stack.back();
+        stack.pop_back();
+        for (int t : nfa[s].eps) {
+            if (!(*mark)[t]) {
+                (*mark)[t] = 1;
+                set->push_back(t);
+                stack.push_back(t);
+            }
+        }
+    }
+    for (int s : *set) (*mark)[s] = 0;
+    std::sort(set->begin(), set->end());
+}
+
+// NFA의 바이트 집합들로 바이트 클래스를 나눕니다. 두 바이트가 모든 집합에 함께 속하거나 함께 빠지면 같은
+// 클래스이므로 어느 DFA 상태에서도 전이가 같습니다. 클래스 수를 반환하고 classes에 바이트별 클래스를 담습니다.
+inline int BuildByteClasses(const std::vector<NfaState>& nfa, uint8_t* classes) {
+    memset(classes, 0, 256);
+    int count = 1;
+    for (const NfaState& state : nfa) {
+        if (state.next < 0) continue;
+        // (기존 클래스, 집합 포함 여부)마다 새 클래스를 줍니다.
+        int16_t split[256][2];
+        for (int k = 0; k < count; ++k) split[k][0] = split[k][1] = -1;
+        int next_count = 0;
+        for (int b = 0; b < 256; ++b) {
+            int16_t& id = split[classes[b]][state.set.Has(static_cast<uint8_t>(b)) ? 1 : 0];
+            if (id < 0) id = static_cast<int16_t>(next_count++);
+            classes[b] = static_cast<uint8_t>(id);
+        }
+        count = next_count;
+        if (count == 256) break;
+    }
+    return count;
+}
+
+// 패턴을 DFA로 컴파일합니다. 지원하지 않는 패턴이거나 상태가 max_states개를 넘으면 false를 반환하고 reason에
+// 원인을 담습니다.
+inline bool BuildMaskDfa(const std::string& pattern, MaskDfa* dfa, std::string* reason,
+                         int max_states = kMaxDfaStates) {
+    std::unique_ptr<RegexNode> root = RegexParser(pattern).Parse(reason);
+    if (root == nullptr) return false;
+
+    NfaBuilder builder;
+    NfaBuilder::Frag frag = builder.Build(*root);
+    if (frag.start < 0) {
+        *reason = "pattern too large";
+        return false;
+    }
+    const std::vector<NfaState>& nfa = builder.states;
+    const int match_state = frag.end;
+
+    int num_classes = BuildByteClasses(nfa, dfa->class_storage);
+    uint8_t representative[256];
+    for (int b = 255; b >= 0; --b) representative[dfa->class_storage[b]] = static_cast<uint8_t>(b);
+
+    // 부분집합 구성. 바이트 전이가 있는 상태와 매치 상태만 DFA 상태의 키로 남깁니다.
+    std::map<std::vector<int>, int> ids;
+    std::vector<std::vector<int>> sets;
+    std::vector<uint8_t> mark(nfa.size(), 0);
+    auto key_of = [&](const std::vector<int>& closure) {
+        std::vector<int> key;
+        for (int s : closure) {
+            if (nfa[s].next >= 0 || s == match_state) key.push_back(s);
+        }
+        return key;
+    };
+    auto intern = [&](std::vector<int> key) {
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+        int id = static_cast<int>(sets.size());
+        ids.emplace(key, id);
+        sets.push_back(std::move(key));
+        return id;
+    };
+
+    intern({});  // 죽은 상태
+    std::vector<int> start_set = {frag.start};
+    NfaClosure(nfa, &start_set, &mark);
+    intern(key_of(start_set));
+
+    // 상태 순번으로 된 전이 표 (상태마다 num_classes개)
+    std::vector<int> next;
+    for (size_t d = 0; d < sets.size(); ++d) {
+        if (sets.size() > static_cast<size_t>(max_states)) {
+            *reason = "too many DFA states";
+            return false;
+        }
+        next.resize((d + 1) * num_classes, 0);
+        if (d == 0) continue;
+        // 같은 대상 집합을 갖는 클래스는 한 번만 계산합니다.
+        std::map<std::vector<int>, int> by_targets;
+        for (int k = 0; k < num_classes; ++k) {
+            std::vector<int> targets;
+            for (int s : sets[d]) {
+                if (nfa[s].next >= 0 && nfa[s].set.Has(representative[k])) targets.push_back(nfa[s].next);
+            }
+            if (targets.empty()) continue;
+            auto cached = by_targets.find(targets);
+            int id;
+            if (cached != by_targets.end()) {
+                id = cached->second;
+            } else {
+                std::vector<int> closure = targets;
+                NfaClosure(nfa, &closure, &mark);
+                id = intern(key_of(closure));
+                by_targets.emplace(std::move(targets), id);
+            }
+            next[d * num_classes + k] = id;
+        }
+    }
+
+    // 죽은 상태, 수락하지 않는 상태, 수락 상태 순으로 번호를 다시 매깁니다.
+    int num_states = static_cast<int>(sets.size());
+    std::vector<uint8_t> accepting(num_states, 0);
+    for (int d = 0; d < num_states; ++d) {
+        accepting[d] = std::binary_search(sets[d].begin(), sets[d].end(), match_state) ? 1 : 0;
+    }
+    std::vector<int> order(num_states);
+    int assigned = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int d = 0; d < num_states; ++d) {
+            if (accepting[d] == pass) order[d] = assigned++;
+        }
+    }
+    int accept_index = num_states;
+    for (int d = 0; d < num_states; ++d) {
+        if (accepting[d]) accept_index = std::min(accept_index, order[d]);
+    }
+
+    int shift = 0;
+    while ((1 << shift) < num_classes) ++shift;
+    int32_t* table = dfa->storage.Allocate(static_cast<size_t>(num_states) << shift);
+    if (table == nullptr) {
+        *reason = "out of memory";
+        return false;
+    }
+    for (int d = 0; d < num_states; ++d) {
+        int32_t* row = table + (static_cast<size_t>(order[d]) << shift);
+        for (int k = 0; k < num_classes; ++k) row[k] = order[next[d * num_classes + k]] << shift;
+    }
+    dfa->Attach(num_states, num_classes, shift, order[1] << shift, accept_index << shift, dfa->class_storage, table);
+    return true;
+}
+
+// 스트림 하나가 스캔하면서 센 통계. mask()의 적응 제어가 창 단위로 모아 기능을 켜고 끕니다.
+struct MaskStreamStats {
+    size_t attempts = 0;    // 매치 시도 수 (사전은 루트를 벗어난 횟수)
+    size_t memo_stops = 0;  // 실패한 시도의 경로와 만나 일찍 멈춘 시도 수
+    size_t skipped = 0;     // 첫 바이트 검색이 건너뛴 바이트 수
+    size_t steps = 0;       // 오토마톤 전이 수 (실패한 시도에서 다시 읽은 바이트 포함)
+};
+
+// 입력을 청크 단위로 받아 leftmost-longest 매치를 찾는 스트리밍 매처. Automaton은 시작 위치가 고정된
+// 오토마톤(MaskDfa, MaskBitNfa)이며 Start/Step/Accepts와 첫 바이트 검색 표 first_finder를 제공합니다.
+// 진행 중인 매치 시도(시작 위치, 상태, 마지막 수락 위치)는 청크 경계를 넘어 유지됩니다.
+// 실패한 시도에서 재시작할 때 이전 바이트를 다시 읽으므로, base부터 Feed한 위치까지의 입력은
+// 스트림이 끝날 때까지 유효해야 합니다.
+//
+// 실패한 시도가 지나간 (위치, 상태)에서는 어떤 매치도 끝나지 않으므로, 다음 시도가 같은
+// (위치, 상태)에 도달하면 더 읽지 않고 멈춥니다. 덕분에 긴 단어 위의 EMAIL 같은 패턴도
+// 시작 위치마다 처음부터 다시 읽지 않습니다. memo가 false이면 이 경로 기록을 끄고, simd가 false이면 첫 바이트
+// 검색에 SIMD 커널 대신 스칼라 루프를 씁니다. 매치 결과는 같습니다.
+template <typename Automaton>
+class MaskMatchStream {
+public:
+    using State = typename Automaton::State;
+
+    MaskMatchStream(const Automaton& automaton, const uint8_t* base, bool memo = true, bool simd = true)
+        : automaton_(automaton),
+          base_(base),
+          find_in_set_(simd ? GetMaskKernels().find_in_set : FindInSetScalar),
+          memo_(memo) {}
+
+    // [이전 위치, end) 구간을 처리합니다. 확정된 매치마다 fn(offset, length)를 호출합니다.
+    template <typename Fn>
+    void Feed(size_t end, Fn&& fn) {
+        Run(end, false, fn);
+    }
+
+    // 입력의 끝입니다. 진행 중인 시도를 마무리합니다.
+    template <typename Fn>
+    void Finish(Fn&& fn) {
+        Run(end_, true, fn);
+    }
+
+    const MaskStreamStats& stats() const { return stats_; }
+
+private:
+    static constexpr size_t kNone = static_cast<size_t>(-1);
+    // 기록하는 경로 길이. 이보다 긴 실패 시도는 앞부분만 기록합니다.
+    static constexpr size_t kTrace = Automaton::kTrace;
+    using TraceState = typename Automaton::TraceState;
+
+    template <typename Fn>
+    void Run(size_t end, bool final, Fn& fn) {
+        end_ = end;
+        while (true) {
+            if (!active_) {
+                const uint8_t* p = base_ + pos_;
+                const uint8_t* e = base_ + end;
+                p = find_in_set_(automaton_.first_finder, p, e);
+                stats_.skipped += static_cast<size_t>(p - base_) - pos_;
+                pos_ = static_cast<size_t>(p - base_);
+                if (pos_ >= end) return;
+                ++stats_.attempts;
+                start_ = pos_;
+                state_ = automaton_.Start();
+                last_ = automaton_.Accepts(state_) ? start_ : kNone;
+                trace_len_ = 0;
+                active_ = true;
+            }
+
+            bool stopped = false;
+            bool merged = false;
+            while (pos_ < end) {
+                State s = automaton_.Step(state_, base_[pos_]);
+                ++pos_;
+                if (s == 0) {
+                    stopped = true;
+                    break;
+                }
+                state_ = s;
+                if (automaton_.Accepts(s)) last_ = pos_;
+                if (!memo_) continue;
+                size_t i = pos_ - dead_start_ - 1;
+                if (pos_ > dead_start_ && i < dead_len_ && dead_[i] == static_cast<TraceState>(s)) {
+                    stopped = true;
+                    merged = true;
+                    ++stats_.memo_stops;
+                    break;
+                }
+                size_t t = pos_ - start_ - 1;
+                if (t == trace_len_ && t < kTrace) trace_[trace_len_++] = static_cast<TraceState>(s);
+            }
+            if (!stopped && !final) return;
+
+            stats_.steps += pos_ - start_;
+            if (last_ != kNone && last_ > start_) {
+                fn(start_, last_ - start_);
+                pos_ = last_;
+            } else {
+                // 수락 없이 끝난 시도의 경로를 기록해 둡니다.
+                if (!merged && trace_len_ > 0) {
+                    std::memcpy(dead_, trace_, trace_len_ * sizeof(TraceState));
+                    dead_start_ = start_;
+                    dead_len_ = trace_len_;
+                }
+                pos_ = start_ + 1;
+            }
+            active_ = false;
+        }
+    }
+
+    const Automaton& automaton_;
+    const uint8_t* base_;
+    FindInSetFn find_in_set_;
+    bool memo_;
+    MaskStreamStats stats_;
+    size_t end_ = 0;
+    size_t pos_ = 0;
+    bool active_ = false;
+    size_t start_ = 0;
+    State state_ = 0;
+    size_t last_ = kNone;
+
+    TraceState trace_[kTrace];
+    size_t trace_len_ = 0;
+    TraceState dead_[kTrace];
+    size_t dead_start_ = 0;
+    size_t dead_len_ = 0;
+};
+
+using DfaStream = MaskMatchStream<MaskDfa>;
+
+// 필수 바이트 후보의 순위. 낮을수록 대개 드문 바이트입니다.
+inline int RequiredByteRank(int b) {
+    if ((b >= '0' && b <= '9') || (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z')) return 2;
+    if (b == ' ' || b >= 0x80) return 1;
+    return 0;
+}
+
+// 모든 매치에 반드시 나타나는 바이트를 찾습니다. 행에 이 바이트가 없으면 스캔할 필요가 없습니다.
+// 여러 개면 영숫자나 공백이 아닌(대개 더 드문) 바이트를 고릅니다. 없으면 -1을 반환합니다.
+inline int FindRequiredByte(const MaskDfa& dfa) {
+    if (dfa.Accepts(dfa.start)) return -1;
+    int best = -1;
+    std::vector<uint8_t> seen(dfa.num_states);
+    std::vector<int32_t> stack;
+    for (int b = 0; b < 256; ++b) {
+        if (best >= 0 && RequiredByteRank(b) >= RequiredByteRank(best)) continue;
+        // b 전이를 모두 지운 DFA에서 수락 상태에 도달할 수 없으면 b는 필수 바이트입니다.
+        std::fill(seen.begin(), seen.end(), 0);
+        stack.assign(1, dfa.start);
+        seen[dfa.start >> dfa.stride_shift] = 1;
+        bool reachable = false;
+        while (!stack.empty() && !reachable) {
+            int32_t s = stack.back();
+            stack.pop_back();
+            for (int c = 0; c < 256; ++c) {
+                int32_t t = dfa.Step(s, static_cast<uint8_t>(c));
+                if (c == b || t == 0 || seen[t >> dfa.stride_shift]) continue;
+                if (dfa.Accepts(t)) {
+                    reachable = true;
+                    break;
+                }
+                seen[t >> dfa.stride_shift] = 1;
+                stack.push_back(t);
+            }
+        }
+        if (!reachable) best = b;
+    }
+    return best;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MaskAutomaton.h"
+
+// 짧은 규칙용 비트 병렬(Shift-And를 일반화한 Glushkov) NFA.
+//
+// Glushkov NFA는 패턴의 문자 위치마다 상태 하나를 두므로 `\d{6}-\d{7}`은 14개 위치입니다. 위치가 63개 이하이면
+// 상태 집합 전체를 64비트 워드 하나에 담고, 바이트 하나를 읽을 때마다
+//
+//     D' = Follow(D) & byte_mask[c]
+//
+// 를 계산합니다. Follow(D)는 D를 8비트씩 나눠 미리 계산한 표를 찾아 OR한 것이므로, 바이트당 위치 8개마다 표 한 번을
+// 읽습니다. 부분집합 구성이나 상태 캐시가 없어 컴파일이 즉시 끝나고, 표도 위치 수에 비례해 몇 KB에 그칩니다.
+// 매칭은 MaskMatchStream이 DFA와 같은 방식(leftmost-longest)으로 합니다.
+
+// 비트 병렬 NFA에 담을 수 있는 위치 수. 비트 0은 시작 상태입니다.
+constexpr int kMaxBitNfaPositions = 63;
+
+struct MaskBitNfa {
+    // MaskMatchStream이 쓰는 상태 형식. 상태는 위치 집합이며 빈 집합(0)이 죽은 상태입니다.
+    using State = uint64_t;
+    using TraceState = uint64_t;
+    static constexpr size_t kTrace = 1024;
+
+    int positions = 0;
+    State accept = 0;                // 수락 위치 (패턴이 빈 문자열과 매치하면 비트 0 포함)
+    State byte_mask[256] = {};       // 바이트 c를 읽을 수 있는 위치
+    std::vector<State> follow;       // 8비트 묶음 k의 값 v에서 갈 수 있는 위치: follow[k * 256 + v]
+    bool first[256];                 // 시작 상태에서 죽지 않는 첫 바이트
+    ByteSetFinder first_finder;      // first 집합의 SIMD 검색 표
+
+    MaskBitNfa() = default;
+    MaskBitNfa(const MaskBitNfa&) = delete;
+    MaskBitNfa& operator=(const MaskBitNfa&) = delete;
+
+    State Start() const { return 1; }
+    State Step(State s, uint8_t c) const {
+        const State* table = follow.data();
+        State next = 0;
+        for (; s != 0; s >>= 8, table += 256) next |= table[s & 0xff];
+        return next & byte_mask[c];
+    }
+    bool Accepts(State s) const { return (s & accept) != 0; }
+
+    size_t Bytes() const { return sizeof(MaskBitNfa) + follow.size() * sizeof(State); }
+};
+
+// 구문 트리에서 Glushkov 위치와 follow 집합을 만듭니다. 반복 {n,m}은 자식을 필요한 만큼 복제합니다.
+class GlushkovBuilder {
+public:
+    // 노드가 만드는 조각의 첫 위치, 끝 위치, 빈 문자열 매치 여부
+    struct Frag {
+        uint64_t first = 0;
+        uint64_t last = 0;
+        bool nullable = true;
+    };
+
+    std::vector<ByteSet> sets = std::vector<ByteSet>(1);  // 위치별 바이트 집합 (0은 시작 상태)
+    uint64_t follow[kMaxBitNfaPositions + 1] = {};
+
+    // 위치가 kMaxBitNfaPositions를 넘으면 false를 반환합니다.
+    bool Build(const RegexNode& node, Frag* out) {
+        // 빈 그룹을 겹겹이 반복하는 패턴이 위치 없이 오래 돌지 않도록 방문 횟수도 제한합니다.
+        if (++visits_ > kMaxVisits) return false;
+        switch (node.kind) {
+            case RegexNode::kEmpty:
+                *out = Frag();
+                return true;
+            case RegexNode::kSet: {
+                if (sets.size() > static_cast<size_t>(kMaxBitNfaPositions)) return false;
+                uint64_t bit = uint64_t{1} << sets.size();
+                sets.push_back(node.set);
+                *out = {bit, bit, false};
+                return true;
+            }
+            case RegexNode::kConcat: {
+                Frag acc;
+                for (const auto& child : node.children) {
+                    Frag f;
+                    if (!Build(*child, &f)) return false;
+                    acc = Concat(acc, f);
+                }
+                *out = acc;
+                return true;
+            }
+            case RegexNode::kAlternate: {
+                Frag acc{0, 0, false};
+                for (const auto& child : node.children) {
+                    Frag f;
+                    if (!Build(*child, &f)) return false;
+                    acc.first |= f.first;
+                    acc.last |= f.last;
+                    acc.nullable = acc.nullable || f.nullable;
+                }
+                *out = acc;
+                return true;
+            }
+            case RegexNode::kRepeat: {
+                const RegexNode& child = *node.children[0];
+                Frag acc;
+                for (int i = 0; i < node.min; ++i) {
+                    Frag f;
+                    if (!Build(child, &f)) return false;
+                    acc = Concat(acc, f);
+                }
+                if (node.max < 0) {
+                    Frag f;
+                    if (!Build(child, &f)) return false;
+                    Link(f.last, f.first);
+                    f.nullable = true;
+                    acc = Concat(acc, f);
+                } else {
+                    for (int i = node.min; i < node.max; ++i) {
+                        Frag f;
+                        if (!Build(child, &f)) return false;
+                        f.nullable = true;
+                        acc = Concat(acc, f);
+                    }
+                }
+                *out = acc;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static constexpr int kMaxVisits = 4096;
+
+    void Link(uint64_t from, uint64_t to) {
+        for (int i = 0; from != 0; ++i, from >>= 1) {
+            if (from & 1) follow[i] |= to;
+        }
+    }
+
+    Frag Concat(const Frag& a, const Frag& b) {
+        Link(a.last, b.first);
+        return {a.first | (a.nullable ? b.first : 0), b.last | (b.nullable ? a.last : 0), a.nullable && b.nullable};
+    }
+
+    int visits_ = 0;
+};
+
+// 패턴을 비트 병렬 NFA로 컴파일합니다. 지원하지 않는 패턴이거나 위치가 너무 많으면 false를 반환하고
+// reason에 원인을 담습니다.
+inline bool BuildMaskBitNfa(const std::string& pattern, MaskBitNfa* nfa, std::string* reason) {
+    std::unique_ptr<RegexNode> root = RegexParser(pattern).Parse(reason);
+    if (root == nullptr) return false;
+
+    GlushkovBuilder builder;
+    GlushkovBuilder::Frag frag;
+    if (!builder.Build(*root, &frag)) {
+        *reason = "too many positions";
+        return false;
+    }
+    builder.follow[0] = frag.first;
+
+    int positions = static_cast<int>(builder.sets.size());
+    nfa->positions = positions - 1;
+    nfa->accept = frag.last | (frag.nullable ? 1 : 0);
+    memset(nfa->byte_mask, 0, sizeof(nfa->byte_mask));
+    for (int p = 1; p < positions; ++p) {
+        for (int b = 0; b < 256; ++b) {
+            if (builder.sets[p].Has(static_cast<uint8_t>(b))) nfa->byte_mask[b] |= uint64_t{1} << p;
+        }
+    }
+    int chunks = (positions + 7) / 8;
+    nfa->follow.assign(static_cast<size_t>(chunks) * 256, 0);
+    for (int k = 0; k < chunks; ++k) {
+        for (int v = 1; v < 256; ++v) {
+            uint64_t to = 0;
+            for (int j = 0; j < 8; ++j) {
+                int p = k * 8 + j;
+                if (((v >> j) & 1) != 0 && p < positions) to |= builder.follow[p];
+            }
+            nfa->follow[k * 256 + v] = to;
+        }
+    }
+    for (int b = 0; b < 256; ++b) nfa->first[b] = (frag.first & nfa->byte_mask[b]) != 0;
+    nfa->first_finder.Build(nfa->first);
+    return true;
+}
+
+using MaskBitNfaStream = MaskMatchStream<MaskBitNfa>;
+
+// 모든 매치에 반드시 나타나는 바이트를 찾습니다 (FindRequiredByte(const MaskDfa&)와 같은 규칙).
+// 바이트 b만 읽을 수 있는 위치를 지운 뒤 시작 상태에서 수락 위치에 닿을 수 없으면 b는 필수 바이트입니다.
+inline int FindRequiredByte(const MaskBitNfa& nfa) {
+    if (nfa.Accepts(nfa.Start())) return -1;
+    int best = -1;
+    for (int b = 0; b < 256; ++b) {
+        if (best >= 0 && RequiredByteRank(b) >= RequiredByteRank(best)) continue;
+        uint64_t allowed = 0;
+        for (int c = 0; c < 256; ++c) {
+            if (c != b) allowed |= nfa.byte_mask[c];
+        }
+        uint64_t reach = nfa.Start();
+        while (true) {
+            uint64_t next = reach;
+            const uint64_t* table = nfa.follow.data();
+            for (uint64_t s = reach; s != 0; s >>= 8, table += 256) next |= table[s & 0xff] & allowed;
+            if (next == reach) break;
+            reach = next;
+        }
+        if (!nfa.Accepts(reach)) best = b;
+    }
+    return best;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "MaskAutomaton.h"
+
+// 빌드 시점에 DFA로 컴파일해 둔 내장 규칙. 표는 mask_gen이 생성한 MaskBuiltinRules.inc에 constexpr 배열로
+// 들어 있어 공유 라이브러리의 읽기 전용 영역에 놓이고, 프로세스 사이에서는 페이지 캐시로 공유됩니다.
+// 이 규칙들은 프래그먼트마다 컴파일하지 않으며, 규칙 파일의 다른 패턴은 지금처럼 런타임에 컴파일합니다.
+struct MaskBuiltinDfa {
+    const char* pattern;
+    int num_states;
+    int num_classes;
+    int stride_shift;
+    int32_t start;
+    int32_t accept_from;
+    const uint8_t* classes;
+    const int32_t* next;  // 64바이트 정렬
+    int required_byte;
+};
+
+#include "MaskBuiltinRules.inc"
+
+// 패턴이 내장 규칙의 패턴과 같으면 그 표를 반환합니다.
+inline const MaskBuiltinDfa* FindBuiltinDfa(const std::string& pattern) {
+    for (const MaskBuiltinDfa& builtin : kMaskBuiltinDfas) {
+        if (pattern == builtin.pattern) return &builtin;
+    }
+    return nullptr;
+}
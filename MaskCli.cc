@@ -0,0 +1,330 @@
+// mask()와 같은 규칙 파일과 마스킹 코어를 사용하는 로컬 파일용 마스킹 도구.
+//
+//   mask_cli [--rules FILE] [--format lines|csv|tsv|jsonl] [--columns 1,3]
+//            [--mask-char C] [--threads N] [--bench] KEY INPUT OUTPUT
+//
+// 입력 파일을 mmap한 뒤 레코드(줄) 경계에서 작은 청크로 나누고, 작업 스레드들이 공유 커서로
+// 다음 청크를 가져가며 처리합니다. 결과는 청크 순서대로 큰 단위의 write()로 씁니다.
+// csv/tsv는 Impala 텍스트 테이블처럼 따옴표 처리 없이 구분자로만 필드를 나누고, 청크의 필드들을
+// UDF와 같은 MaskBatch로 마스킹하므로 결과가 UDF와 바이트 단위로 같습니다.
+// --bench는 규칙의 엔진과 오토마톤 메모리, 마스킹에 쓴 사이클당 전이 수와 바이트 수를 stderr에 한 줄로 남깁니다.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#include "MaskEngine.h"
+
+// 청크 하나의 목표 크기. 레코드 경계까지 늘어날 수 있습니다.
+constexpr size_t kChunkSize = 1 << 20;
+
+struct CliOptions {
+    std::string rules_path = MaskRulesPath();
+    std::string key;
+    std::string input_path;
+    std::string output_path;
+    char delimiter = '\0';  // '\0'이면 줄 전체를 하나의 값으로 봅니다 (lines, jsonl)
+    std::vector<int> columns;  // 1부터 시작하는 필드 번호. 비어 있으면 모든 필드
+    char mask_char = '*';
+    int threads = 0;
+    bool bench = false;
+};
+
+struct Chunk {
+    size_t begin;
+    size_t end;
+    std::string output;
+    bool done = false;
+    uint64_t cycles = 0;       // MaskBatch에 쓴 사이클 (--bench)
+    uint64_t bytes = 0;        // 마스킹한 필드의 바이트
+    uint64_t transitions = 0;  // 오토마톤 전이 수
+};
+
+// 벤치마크용 사이클 카운터 (TSC). x86-64가 아니면 나노초로 대신합니다.
+inline uint64_t CycleCount() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+#endif
+}
+
+void Usage() {
+    fprintf(stderr,
+            "usage: mask_cli [--rules FILE] [--format lines|csv|tsv|jsonl] [--columns 1,3]\n"
+            "                [--mask-char C] [--threads N] [--bench] KEY INPUT OUTPUT\n");
+}
+
+bool ParseOptions(int argc, char** argv, CliOptions* options) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--rules" && has_value) {
+            options->rules_path = argv[++i];
+        } else if (arg == "--format" && has_value) {
+            std::string format = argv[++i];
+            if (format == "csv") {
+                options->delimiter = ',';
+            } else if (format == "tsv") {
+                options->delimiter = '\t';
+            } else if (format == "lines" || format == "jsonl") {
+                options->delimiter = '\0';
+            } else {
+                fprintf(stderr, "unknown format '%s'\n", format.c_str());
+                return false;
+            }
+        } else if (arg == "--columns" && has_value) {
+            std::string error;
+            if (!ParseMaskGroups(argv[++i], &options->columns, &error)) {
+                fprintf(stderr, "--columns: %s\n", error.c_str());
+                return false;
+            }
+        } else if (arg == "--mask-char" && has_value) {
+            std::string value = argv[++i];
+            if (value.size() != 1) {
+                fprintf(stderr, "--mask-char must be a single byte\n");
+                return false;
+            }
+            options->mask_char = value[0];
+        } else if (arg == "--threads" && has_value) {
+            options->threads = std::atoi(argv[++i]);
+        } else if (arg == "--bench") {
+            options->bench = true;
+        } else if (!arg.empty() && arg[0] == '-' && arg != "-") {
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 3) return false;
+    options->key = positional[0];
+    options->input_path = positional[1];
+    options->output_path = positional[2];
+    if (options->threads <= 0) options->threads = std::max(1u, std::thread::hardware_concurrency());
+    return true;
+}
+
+bool IsSelectedColumn(const CliOptions& options, int column) {
+    if (options.columns.empty()) return true;
+    return std::find(options.columns.begin(), options.columns.end(), column) != options.columns.end();
+}
+
+// 레코드 하나(줄 끝 제외)에서 마스킹할 필드를 fields 뒤에 덧붙입니다.
+void CollectFields(const CliOptions& options, const char* begin, const char* end, std::vector<MaskBytes>* fields) {
+    if (options.delimiter == '\0') {
+        fields->push_back({begin, static_cast<size_t>(end - begin)});
+        return;
+    }
+    int column = 1;
+    const char* field = begin;
+    while (true) {
+        const char* field_end = static_cast<const char*>(memchr(field, options.delimiter, end - field));
+        if (field_end == nullptr) field_end = end;
+        if (IsSelectedColumn(options, column)) fields->push_back({field, static_cast<size_t>(field_end - field)});
+        if (field_end == end) break;
+        field = field_end + 1;
+        ++column;
+    }
+}
+
+// 청크를 출력 버퍼에 복사한 뒤, 마스킹할 필드를 모아 배치로 마스킹합니다.
+// 마스킹해도 길이가 바뀌지 않으므로 각 필드의 결과는 출력 버퍼의 같은 위치에 씁니다.
+void MaskChunk(const CompiledRule& rule, const CliOptions& options, const char* data, Chunk* chunk) {
+    const char* begin = data + chunk->begin;
+    const char* end = data + chunk->end;
+    chunk->output.assign(begin, end);
+
+    std::vector<MaskBytes> fields;
+    const char* p = begin;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* record_end = eol != nullptr ? eol : end;
+        CollectFields(options, p, record_end, &fields);
+        if (eol == nullptr) break;
+        p = eol + 1;
+    }
+
+    std::vector<char*> outputs(fields.size());
+    for (size_t i = 0; i < fields.size(); ++i) outputs[i] = &chunk->output[fields[i].ptr - begin];
+    std::vector<MaskScanResult> results(fields.size());
+    uint64_t start = options.bench ? CycleCount() : 0;
+    MaskBatch(rule, fields.data(), outputs.data(), fields.size(), options.mask_char, results.data());
+    if (!options.bench) return;
+    chunk->cycles = CycleCount() - start;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        chunk->bytes += fields[i].len;
+        chunk->transitions += results[i].stream.steps;
+    }
+}
+
+// 입력을 레코드 경계에 맞춰 kChunkSize 안팎의 청크로 나눕니다.
+std::vector<Chunk> SplitChunks(const char* data, size_t size) {
+    std::vector<Chunk> chunks;
+    size_t begin = 0;
+    while (begin < size) {
+        size_t end = std::min(size, begin + kChunkSize);
+        if (end < size) {
+            const char* eol = static_cast<const char*>(memchr(data + end, '\n', size - end));
+            end = eol != nullptr ? static_cast<size_t>(eol - data) + 1 : size;
+        }
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = end;
+        chunks.push_back(std::move(chunk));
+        begin = end;
+    }
+    return chunks;
+}
+
+bool WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    CliOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        Usage();
+        return 2;
+    }
+
+    std::vector<MaskRuleSpec> specs;
+    std::string error;
+    if (!LoadMaskRules(options.rules_path, &specs, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::unique_ptr<CompiledRule> rule;
+    for (const MaskRuleSpec& spec : specs) {
+        if (spec.key == options.key) rule = CompileMaskRule(spec, &error);
+    }
+    if (rule == nullptr) {
+        fprintf(stderr, "%s\n", error.empty() ? ("unknown rule key " + options.key).c_str() : error.c_str());
+        return 1;
+    }
+
+    int in_fd = open(options.input_path.c_str(), O_RDONLY);
+    if (in_fd < 0) {
+        perror(options.input_path.c_str());
+        return 1;
+    }
+    struct stat st;
+    if (fstat(in_fd, &st) != 0) {
+        perror(options.input_path.c_str());
+        return 1;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    const char* data = nullptr;
+    if (size > 0) {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+        if (mapped == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+    }
+
+    int out_fd = open(options.output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        perror(options.output_path.c_str());
+        return 1;
+    }
+
+    std::vector<Chunk> chunks = SplitChunks(data, size);
+
+    // 작업 스레드는 공유 커서에서 다음 청크를 가져갑니다. 메모리를 제한하기 위해
+    // 아직 쓰지 않은 청크가 window개를 넘으면 기다립니다.
+    const size_t window = static_cast<size_t>(options.threads) * 4;
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t next_chunk = 0;
+    size_t written = 0;
+
+    auto worker = [&]() {
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return next_chunk >= chunks.size() || next_chunk < written + window; });
+                if (next_chunk >= chunks.size()) return;
+                index = next_chunk++;
+            }
+            MaskChunk(*rule, options, data, &chunks[index]);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                chunks[index].done = true;
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.threads; ++i) threads.emplace_back(worker);
+
+    bool ok = true;
+    uint64_t cycles = 0;
+    uint64_t bytes = 0;
+    uint64_t transitions = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return chunks[i].done; });
+        }
+        if (ok && !WriteAll(out_fd, chunks[i].output.data(), chunks[i].output.size())) {
+            perror(options.output_path.c_str());
+            ok = false;
+        }
+        std::string().swap(chunks[i].output);
+        cycles += chunks[i].cycles;
+        bytes += chunks[i].bytes;
+        transitions += chunks[i].transitions;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            written = i + 1;
+        }
+        cv.notify_all();
+    }
+    for (std::thread& t : threads) t.join();
+
+    // 사이클은 모든 스레드의 MaskBatch 시간을 더한 것이므로 스레드 하나의 처리량입니다.
+    if (options.bench) {
+        double per_cycle = cycles != 0 ? 1.0 / static_cast<double>(cycles) : 0.0;
+        fprintf(stderr,
+                "bench rule=%s engine=%s memory=%zu bytes=%llu cycles=%llu transitions=%llu "
+                "transitions_per_cycle=%.3f bytes_per_cycle=%.3f\n",
+                rule->key.c_str(), MaskEngineName(rule->plan.engine), MaskRuleMemory(*rule),
+                static_cast<unsigned long long>(bytes), static_cast<unsigned long long>(cycles),
+                static_cast<unsigned long long>(transitions), static_cast<double>(transitions) * per_cycle,
+                static_cast<double>(bytes) * per_cycle);
+    }
+
+    if (data != nullptr) munmap(const_cast<char*>(data), size);
+    close(in_fd);
+    if (close(out_fd) != 0) ok = false;
+    return ok ? 0 : 1;
+}
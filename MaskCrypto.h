@@ -0,0 +1,294 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// 키 파일로부터 읽은 128비트 비밀 키
+struct MaskSecret {
+    uint8_t bytes[16];
+};
+
+// 키 파일 디렉터리: IMPALA_MASK_KEY_DIR 환경 변수가 있으면 그 값을 사용합니다.
+inline std::string MaskKeyDir() {
+    const char* env = std::getenv("IMPALA_MASK_KEY_DIR");
+    if (env != nullptr && env[0] != '\0') return env;
+    return "/etc/impala/udf/keys";
+}
+
+inline int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// secret_ref 이름의 키 파일(<키 디렉터리>/<secret_ref>.key)에서 32자리 16진수 키를 읽습니다.
+// secret_ref에는 경로 구분자를 쓸 수 없습니다.
+inline bool LoadMaskSecret(const std::string& secret_ref, MaskSecret* secret, std::string* error) {
+    if (secret_ref.empty() || secret_ref[0] == '.' ||
+        secret_ref.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-") !=
+            std::string::npos) {
+        *error = "invalid secret reference '" + secret_ref + "'";
+        return false;
+    }
+    std::string path = MaskKeyDir() + "/" + secret_ref + ".key";
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        *error = "cannot open key file " + path;
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string hex = ss.str();
+    hex.erase(hex.find_last_not_of(" \t\r\n") + 1);
+    if (hex.size() != 32) {
+        *error = path + ": expected 32 hex digits";
+        return false;
+    }
+    for (int i = 0; i < 16; ++i) {
+        int hi = HexValue(hex[2 * i]);
+        int lo = HexValue(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            *error = path + ": expected 32 hex digits";
+            return false;
+        }
+        secret->bytes[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return true;
+}
+
+inline uint64_t LoadLE64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+// SipHash-2-4 키. 키 파일을 읽을 때 한 번만 풀어 두고 행마다 다시 만들지 않습니다.
+struct SipHashKey {
+    uint64_t k0;
+    uint64_t k1;
+};
+
+inline SipHashKey MakeSipHashKey(const MaskSecret& secret) {
+    return {LoadLE64(secret.bytes), LoadLE64(secret.bytes + 8)};
+}
+
+#define SIPROUND                                                        \
+    do {                                                                \
+        v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+        v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2;               \
+        v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0;               \
+        v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32); \
+    } while (0)
+
+// SipHash-2-4 (64비트 출력). 힙 할당 없이 입력을 그대로 읽습니다.
+inline uint64_t SipHash24(const SipHashKey& key, const uint8_t* data, size_t len) {
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key.k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key.k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key.k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ key.k1;
+
+    const uint8_t* end = data + (len & ~static_cast<size_t>(7));
+    for (; data != end; data += 8) {
+        uint64_t m = LoadLE64(data);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    uint64_t b = static_cast<uint64_t>(len) << 56;
+    switch (len & 7) {
+        case 7: b |= static_cast<uint64_t>(data[6]) << 48; // fallthrough
+        case 6: b |= static_cast<uint64_t>(data[5]) << 40; // fallthrough
+        case 5: b |= static_cast<uint64_t>(data[4]) << 32; // fallthrough
+        case 4: b |= static_cast<uint64_t>(data[3]) << 24; // fallthrough
+        case 3: b |= static_cast<uint64_t>(data[2]) << 16; // fallthrough
+        case 2: b |= static_cast<uint64_t>(data[1]) << 8;  // fallthrough
+        case 1: b |= static_cast<uint64_t>(data[0]); break;
+        case 0: break;
+    }
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#undef SIPROUND
+
+// 토큰 길이: SipHash 64비트 값을 16자리 소문자 16진수로 씁니다.
+constexpr size_t kMaskTokenLength = 16;
+
+inline void WriteMaskToken(const SipHashKey& key, const char* value, size_t len, char* out) {
+    static const char kHex[] = "0123456789abcdef";
+    uint64_t h = SipHash24(key, reinterpret_cast<const uint8_t*>(value), len);
+    for (int i = static_cast<int>(kMaskTokenLength) - 1; i >= 0; --i) {
+        out[i] = kHex[h & 0xf];
+        h >>= 4;
+    }
+}
+
+// AES-128 암호화(정방향만). FF1은 암호화와 복호화 모두 정방향 블록 암호만 사용합니다.
+// 라운드 키는 키 파일을 읽을 때 한 번만 확장해 둡니다.
+struct Aes128 {
+    uint8_t round_keys[176];
+
+    static const uint8_t* SBox() {
+        static const uint8_t kSBox[256] = {
+            0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+            0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+            0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+            0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+            0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+            0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+            0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+            0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+            0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+            0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+            0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+            0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+            0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+            0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+            0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+            0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+        };
+        return kSBox;
+    }
+
+    static uint8_t XTime(uint8_t x) { return static_cast<uint8_t>((x << 1) ^ ((x >> 7) * 0x1b)); }
+
+    void SetKey(const uint8_t key[16]) {
+        const uint8_t* sbox = SBox();
+        memcpy(round_keys, key, 16);
+        uint8_t rcon = 1;
+        for (int i = 16; i < 176; i += 4) {
+            uint8_t t[4] = {round_keys[i - 4], round_keys[i - 3], round_keys[i - 2], round_keys[i - 1]};
+            if (i % 16 == 0) {
+                uint8_t first = t[0];
+                t[0] = static_cast<uint8_t>(sbox[t[1]] ^ rcon);
+                t[1] = sbox[t[2]];
+                t[2] = sbox[t[3]];
+                t[3] = sbox[first];
+                rcon = XTime(rcon);
+            }
+            for (int j = 0; j < 4; ++j) round_keys[i + j] = round_keys[i - 16 + j] ^ t[j];
+        }
+    }
+
+    void Encrypt(const uint8_t in[16], uint8_t out[16]) const {
+        const uint8_t* sbox = SBox();
+        uint8_t s[16];
+        for (int i = 0; i < 16; ++i) s[i] = in[i] ^ round_keys[i];
+        for (int round = 1; round <= 10; ++round) {
+            // SubBytes + ShiftRows
+            uint8_t t[16];
+            for (int c = 0; c < 4; ++c) {
+                for (int r = 0; r < 4; ++r) t[4 * c + r] = sbox[s[4 * ((c + r) & 3) + r]];
+            }
+            // MixColumns (마지막 라운드 제외) + AddRoundKey
+            const uint8_t* rk = round_keys + 16 * round;
+            for (int c = 0; c < 4; ++c) {
+                uint8_t* col = t + 4 * c;
+                if (round != 10) {
+                    uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+                    uint8_t c0 = col[0];
+                    col[0] ^= all ^ XTime(col[0] ^ col[1]);
+                    col[1] ^= all ^ XTime(col[1] ^ col[2]);
+                    col[2] ^= all ^ XTime(col[2] ^ col[3]);
+                    col[3] ^= all ^ XTime(col[3] ^ c0);
+                }
+                for (int r = 0; r < 4; ++r) s[4 * c + r] = col[r] ^ rk[4 * c + r];
+            }
+        }
+        memcpy(out, s, 16);
+    }
+};
+
+// FF1 (NIST SP 800-38G) 형식 보존 암호, radix 10, 빈 tweak.
+// 숫자 길이 n마다 CBC-MAC의 첫 블록 AES(P)가 고정되므로 키를 읽을 때 미리 계산해 두고,
+// 각 라운드는 AES 한 번으로 끝납니다. 한 행의 여러 매치는 라운드 단위로 묶어 처리합니다.
+// SP 800-38G Rev.1은 도메인 크기(radix^n)가 10^6 이상이어야 하므로 최소 6자리입니다.
+constexpr int kFf1MinDigits = 6;
+constexpr int kFf1MaxDigits = 36;
+
+struct Ff1Key {
+    Aes128 aes;
+    uint8_t p_mac[kFf1MaxDigits + 1][16];
+};
+
+inline void MakeFf1Key(const MaskSecret& secret, Ff1Key* key) {
+    key->aes.SetKey(secret.bytes);
+    memset(key->p_mac, 0, sizeof(key->p_mac));
+    for (int n = kFf1MinDigits; n <= kFf1MaxDigits; ++n) {
+        int u = n / 2;
+        uint8_t p[16] = {1, 2, 1, 0, 0, 10, 10, static_cast<uint8_t>(u), 0, 0, 0, static_cast<uint8_t>(n),
+                         0, 0, 0, 0};
+        key->aes.Encrypt(p, key->p_mac[n]);
+    }
+}
+
+// FF1 한 건의 진행 상태. 숫자열을 앞(u자리)과 뒤(v자리) 절반의 정수로 나눠 들고 있습니다.
+struct Ff1Item {
+    uint64_t a;
+    uint64_t b;
+    int n;
+};
+
+inline uint64_t Pow10(int m) {
+    uint64_t r = 1;
+    while (m-- > 0) r *= 10;
+    return r;
+}
+
+// 10 라운드를 items 전체에 대해 라운드 단위로 적용합니다.
+inline void Ff1Batch(const Ff1Key& key, bool decrypt, Ff1Item* items, int count) {
+    for (int step = 0; step < 10; ++step) {
+        int round = decrypt ? 9 - step : step;
+        for (int k = 0; k < count; ++k) {
+            Ff1Item& item = items[k];
+            int u = item.n / 2;
+            int v = item.n - u;
+            // b = ceil(ceil(v * log2(10)) / 8), d = 4 * ceil(b / 4) + 4
+            int bits = static_cast<int>((v * 3321928LL + 999999) / 1000000);
+            int b = (bits + 7) / 8;
+            int d = 4 * ((b + 3) / 4) + 4;
+
+            uint64_t num = decrypt ? item.a : item.b;
+            uint8_t q[16] = {0};
+            q[15 - b] = static_cast<uint8_t>(round);
+            for (int j = 0; j < b; ++j) q[15 - j] = static_cast<uint8_t>(num >> (8 * j));
+            for (int j = 0; j < 16; ++j) q[j] ^= key.p_mac[item.n][j];
+            uint8_t r[16];
+            key.aes.Encrypt(q, r);
+
+            int m = (round % 2 == 0) ? u : v;
+            uint64_t modulus = Pow10(m);
+            unsigned __int128 y = 0;
+            for (int j = 0; j < d; ++j) y = ((y << 8) | r[j]) % modulus;
+            uint64_t ym = static_cast<uint64_t>(y);
+
+            if (!decrypt) {
+                uint64_t c = (item.a % modulus + ym) % modulus;
+                item.a = item.b;
+                item.b = c;
+            } else {
+                uint64_t c = (item.b % modulus + modulus - ym) % modulus;
+                item.b = item.a;
+                item.a = c;
+            }
+        }
+    }
+}
@@ -0,0 +1,539 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MaskAutomaton.h"
+#include "MaskSimd.h"
+
+// 사전(DICT) 규칙의 Aho-Corasick 오토마톤.
+//
+// 단어 목록 파일(한 줄에 한 단어, 빈 줄은 무시)의 단어들을 바이트 단위 트라이로 만들고, 트라이를 double-array
+// (base/check)로 압축한 뒤 실패 링크를 붙입니다. 상태 s에서 바이트 c로의 전이는 check[base[s] + c] == s일 때
+// base[s] + c이며, 없으면 실패 링크를 따라갑니다. 수십만 단어도 상태당 20바이트로 표현됩니다.
+//
+// 컴파일한 표는 캐시 디렉터리(IMPALA_MASK_DICT_CACHE_DIR, 기본 /tmp)에 파일로 직렬화하고 mmap해서 씁니다.
+// 같은 프로세스의 프래그먼트는 매핑 하나를 공유하고, 다른 프로세스도 같은 파일의 페이지 캐시를 공유합니다.
+// 캐시 파일은 단어 목록의 경로, 크기, 수정 시각으로 찾으므로 목록을 고치면 새로 만들어집니다.
+//
+// 매치는 사전의 모든 단어의 모든 출현이며, 서로 겹치는 출현은 하나의 구간으로 합칩니다(인접한 출현은 합치지 않음).
+// 단어 경계나 대소문자는 따로 처리하지 않고 바이트가 정확히 같을 때만 매치합니다.
+
+// 캐시 파일의 형식 번호. 배치가 바뀌면 올립니다(이전 형식의 캐시 파일은 무시하고 다시 만듭니다).
+constexpr uint32_t kMaskDictFormat = 1;
+
+struct MaskDictHeader {
+    char magic[8];          // "IMDICT\0\0"
+    uint32_t format;        // kMaskDictFormat
+    uint32_t num_slots;     // 아래 배열 각각의 항목 수
+    uint32_t num_words;
+    uint32_t max_depth;     // 가장 긴 단어의 바이트 수
+    uint64_t source_size;   // 단어 목록 파일의 크기
+    int64_t source_mtime;   // 단어 목록 파일의 수정 시각 (ns)
+    // 이어서 int32_t base[num_slots], check[num_slots], fail[num_slots], out_len[num_slots], depth[num_slots]
+};
+static_assert(sizeof(MaskDictHeader) % sizeof(int32_t) == 0, "MaskDictHeader must be int32-aligned");
+
+constexpr size_t kMaskDictHeaderWords = sizeof(MaskDictHeader) / sizeof(int32_t);
+constexpr char kMaskDictMagic[8] = {'I', 'M', 'D', 'I', 'C', 'T', 0, 0};
+
+// 상태 0은 루트입니다. 빈 슬롯과 루트 슬롯의 check는 -1입니다.
+struct MaskDict {
+    uint32_t num_slots = 0;
+    uint32_t num_words = 0;
+    uint32_t max_depth = 0;            // 가장 긴 단어의 바이트 수
+    const int32_t* base = nullptr;
+    const int32_t* check = nullptr;
+    const int32_t* fail = nullptr;     // 실패 링크
+    const int32_t* out_len = nullptr;  // 이 상태에서 끝나는 가장 긴 단어의 길이. 없으면 0
+    const int32_t* depth = nullptr;    // 루트에서 이 상태까지의 바이트 수
+    bool first[256];                   // 단어를 시작할 수 있는 바이트
+    ByteSetFinder first_finder;        // first 집합의 SIMD 검색 표
+    uint64_t source_size = 0;
+    int64_t source_mtime = 0;
+
+    MaskDict() = default;
+    MaskDict(const MaskDict&) = delete;
+    MaskDict& operator=(const MaskDict&) = delete;
+
+    ~MaskDict() {
+        if (map_ != nullptr) munmap(map_, map_len_);
+    }
+
+    // 표가 차지하는 바이트 (헤더 포함)
+    size_t Bytes() const { return map_ != nullptr ? map_len_ : storage_.size() * sizeof(int32_t); }
+
+    // 헤더로 시작하는 표를 가리키게 하고 first를 계산합니다. 표는 검증을 거친 것이어야 합니다.
+    void Attach(const int32_t* image) {
+        MaskDictHeader header;
+        memcpy(&header, image, sizeof(header));
+        num_slots = header.num_slots;
+        num_words = header.num_words;
+        max_depth = header.max_depth;
+        source_size = header.source_size;
+        source_mtime = header.source_mtime;
+        const int32_t* arrays = image + kMaskDictHeaderWords;
+        base = arrays;
+        check = arrays + num_slots;
+        fail = arrays + 2 * static_cast<size_t>(num_slots);
+        out_len = arrays + 3 * static_cast<size_t>(num_slots);
+        depth = arrays + 4 * static_cast<size_t>(num_slots);
+        for (int b = 0; b < 256; ++b) first[b] = check[base[0] + b] == 0;
+        first_finder.Build(first);
+    }
+
+    // 메모리에 만든 표를 넘겨받습니다(캐시 파일을 쓰거나 매핑하지 못한 경우).
+    void Own(std::vector<int32_t> image) {
+        storage_ = std::move(image);
+        Attach(storage_.data());
+    }
+
+    // 매핑한 캐시 파일을 넘겨받습니다. 소멸할 때 munmap합니다.
+    void AdoptMapping(void* map, size_t len) {
+        map_ = map;
+        map_len_ = len;
+        Attach(static_cast<const int32_t*>(map));
+    }
+
+private:
+    std::vector<int32_t> storage_;
+    void* map_ = nullptr;
+    size_t map_len_ = 0;
+};
+
+// 표의 모든 인덱스가 범위 안에 있는지 검사합니다. 캐시 파일을 매핑한 뒤 행을 처리하기 전에 한 번 확인합니다.
+inline bool ValidateMaskDictImage(const int32_t* image, size_t words) {
+    if (words < kMaskDictHeaderWords) return false;
+    MaskDictHeader header;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, kMaskDictMagic, sizeof(kMaskDictMagic)) != 0 || header.format != kMaskDictFormat) {
+        return false;
+    }
+    size_t n = header.num_slots;
+    if (n < 257 || words != kMaskDictHeaderWords + 5 * n) return false;
+    const int32_t* base = image + kMaskDictHeaderWords;
+    const int32_t* check = base + n;
+    const int32_t* fail = base + 2 * n;
+    const int32_t* out_len = base + 3 * n;
+    const int32_t* depth = base + 4 * n;
+    if (check[0] != -1 || depth[0] != 0 || out_len[0] != 0) return false;
+    for (size_t s = 0; s < n; ++s) {
+        if (base[s] < 0 || static_cast<size_t>(base[s]) + 256 > n) return false;
+        if (check[s] < -1 || check[s] >= static_cast<int64_t>(n)) return false;
+        if (fail[s] < 0 || static_cast<size_t>(fail[s]) >= n) return false;
+        if (check[s] < 0) continue;
+        // 상태의 깊이는 지나온 바이트 수를 넘지 않아야 하고(구간이 입력 밖으로 나가지 않음), 실패 링크는 루트나
+        // 더 얕은 상태를 가리켜야 실패 링크를 따라가는 루프가 끝납니다.
+        if (depth[s] != depth[check[s]] + 1 || out_len[s] < 0 || out_len[s] > depth[s]) return false;
+        if (fail[s] != 0 && (check[fail[s]] < 0 || depth[fail[s]] >= depth[s])) return false;
+    }
+    return true;
+}
+
+// 단어 목록으로 헤더와 표를 만듭니다.
+inline std::vector<int32_t> BuildMaskDictImage(std::vector<std::string> words, uint64_t source_size,
+                                               int64_t source_mtime) {
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+
+    // 1. 트라이. 단어가 정렬되어 있으므로 새 자식은 항상 마지막 자식보다 큰 바이트입니다.
+    struct TrieNode {
+        std::vector<std::pair<uint8_t, int32_t>> children;
+        bool word = false;
+    };
+    std::vector<TrieNode> trie(1);
+    uint32_t max_depth = 0;
+    for (const std::string& word : words) {
+        int32_t node = 0;
+        for (char ch : word) {
+            uint8_t c = static_cast<uint8_t>(ch);
+            auto& children = trie[node].children;
+            if (!children.empty() && children.back().first == c) {
+                node = children.back().second;
+            } else {
+                int32_t child = static_cast<int32_t>(trie.size());
+                children.emplace_back(c, child);
+                trie.emplace_back();
+                node = child;
+            }
+        }
+        trie[node].word = true;
+        max_depth = std::max(max_depth, static_cast<uint32_t>(word.size()));
+    }
+
+    // 2. double-array 배치. 너비 우선 순서로 각 노드의 자식들이 모두 빈 슬롯에 들어가는 가장 작은 base를 찾습니다.
+    //    next_free는 "i 이상인 가장 작은 빈 슬롯"을 경로 압축으로 찾는 링크입니다(next_free[i] == i이면 빈 슬롯).
+    std::vector<int32_t> next_free;
+    auto find_free = [&](int32_t i) {
+        while (next_free.size() <= static_cast<size_t>(i) + 1) next_free.push_back(static_cast<int32_t>(next_free.size()));
+        int32_t root = i;
+        while (next_free[root] != root) {
+            root = next_free[root];
+            while (next_free.size() <= static_cast<size_t>(root) + 1) {
+                next_free.push_back(static_cast<int32_t>(next_free.size()));
+            }
+        }
+        while (next_free[i] != root) {
+            int32_t up = next_free[i];
+            next_free[i] = root;
+            i = up;
+        }
+        return root;
+    };
+    auto is_free = [&](int32_t i) { return static_cast<size_t>(i) >= next_free.size() || next_free[i] == i; };
+    auto occupy = [&](int32_t i) {
+        find_free(i);
+        next_free[i] = i + 1;
+    };
+
+    std::vector<int32_t> slot_of(trie.size(), 0);
+    std::vector<int32_t> base_of(trie.size(), 1);
+    std::vector<int32_t> order;  // 너비 우선 순서의 트라이 노드
+    order.reserve(trie.size());
+    order.push_back(0);
+    occupy(0);
+    int32_t max_slot = 0;
+    // 앞쪽의 조밀한 구간에 남은 빈 슬롯을 노드마다 다시 훑지 않도록, 오래 걸린 검색 뒤에는 시작 위치를 옮깁니다.
+    int32_t search_from = 1;
+    for (size_t k = 0; k < order.size(); ++k) {
+        const TrieNode& node = trie[order[k]];
+        if (node.children.empty()) continue;
+        int32_t c0 = node.children.front().first;
+        int32_t pos = find_free(std::max(search_from, c0 + 1));
+        for (int tries = 0;; ++tries) {
+            if (tries == 64) search_from = pos;
+            int32_t b = pos - c0;
+            bool fits = true;
+            for (const auto& child : node.children) {
+                if (!is_free(b + child.first)) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) break;
+            pos = find_free(pos + 1);
+        }
+        int32_t b = pos - c0;
+        base_of[order[k]] = b;
+        for (const auto& child : node.children) {
+            occupy(b + child.first);
+            slot_of[child.second] = b + child.first;
+            max_slot = std::max(max_slot, b + child.first);
+            order.push_back(child.second);
+        }
+    }
+
+    // 어느 상태에서든 base + 255가 배열 안에 있도록 256칸을 더 둡니다.
+    int32_t max_base = *std::max_element(base_of.begin(), base_of.end());
+    uint32_t n = static_cast<uint32_t>(std::max(max_slot + 1, max_base + 256));
+
+    std::vector<int32_t> image(kMaskDictHeaderWords + 5 * static_cast<size_t>(n), 0);
+    int32_t* base = image.data() + kMaskDictHeaderWords;
+    int32_t* check = base + n;
+    int32_t* fail = base + 2 * static_cast<size_t>(n);
+    int32_t* out_len = base + 3 * static_cast<size_t>(n);
+    int32_t* depth = base + 4 * static_cast<size_t>(n);
+    std::fill(base, base + n, 1);
+    std::fill(check, check + n, -1);
+    for (int32_t node : order) {
+        int32_t s = slot_of[node];
+        base[s] = base_of[node];
+        for (const auto& child : trie[node].children) check[slot_of[child.second]] = s;
+    }
+
+    // 3. 실패 링크와 출력. 너비 우선 순서이므로 실패 링크가 가리키는 얕은 상태는 이미 채워져 있습니다.
+    for (int32_t node : order) {
+        int32_t s = slot_of[node];
+        for (const auto& child : trie[node].children) {
+            int32_t t = slot_of[child.second];
+            int32_t f = 0;
+            if (s != 0) {
+                f = fail[s];
+                while (true) {
+                    int32_t next = base[f] + child.first;
+                    if (check[next] == f) {
+                        f = next;
+                        break;
+                    }
+                    if (f == 0) break;
+                    f = fail[f];
+                }
+            }
+            fail[t] = f;
+            depth[t] = depth[s] + 1;
+            out_len[t] = trie[child.second].word ? depth[t] : out_len[f];
+        }
+    }
+
+    MaskDictHeader header = {};
+    memcpy(header.magic, kMaskDictMagic, sizeof(kMaskDictMagic));
+    header.format = kMaskDictFormat;
+    header.num_slots = n;
+    header.num_words = static_cast<uint32_t>(words.size());
+    header.max_depth = max_depth;
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+// 사전의 단어가 limit개 이하이면 모두 words에 담고 true를 반환합니다. 더 많으면 false입니다.
+// 루트에서 트라이를 따라가며 out_len이 깊이와 같은(그 상태에서 단어가 끝나는) 상태를 모읍니다.
+inline bool MaskDictWords(const MaskDict& dict, size_t limit, std::vector<std::string>* words) {
+    words->clear();
+    std::string path;
+    struct Frame {
+        int32_t state;
+        int next;  // 다음에 볼 바이트
+    };
+    std::vector<Frame> stack(1, Frame{0, 0});
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.next == 256) {
+            stack.pop_back();
+            if (!path.empty()) path.pop_back();
+            continue;
+        }
+        int b = frame.next++;
+        int64_t t = static_cast<int64_t>(dict.base[frame.state]) + b;
+        if (t <= 0 || t >= dict.num_slots || dict.check[t] != frame.state) continue;
+        path.push_back(static_cast<char>(b));
+        if (dict.out_len[t] == dict.depth[t]) {
+            if (words->size() == limit) return false;
+            words->push_back(path);
+        }
+        stack.push_back(Frame{static_cast<int32_t>(t), 0});
+    }
+    return true;
+}
+
+// 규칙 파일에 적힌 짧은 단어 목록(키워드 등)의 사전. 캐시 파일 없이 메모리에서만 씁니다.
+inline std::shared_ptr<const MaskDict> MakeMaskDict(std::vector<std::string> words) {
+    std::shared_ptr<MaskDict> dict(new MaskDict());
+    dict->Own(BuildMaskDictImage(std::move(words), 0, 0));
+    return dict;
+}
+
+// 캐시 파일 경로: 단어 목록의 경로, 크기, 수정 시각과 형식 번호의 해시로 이름을 정합니다.
+inline std::string MaskDictCachePath(const std::string& path, uint64_t size, int64_t mtime) {
+    const char* env = std::getenv("IMPALA_MASK_DICT_CACHE_DIR");
+    std::string dir = env != nullptr && env[0] != '\0' ? env : "/tmp";
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&](const void* p, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            h ^= static_cast<const uint8_t*>(p)[i];
+            h *= 1099511628211ull;
+        }
+    };
+    mix(path.data(), path.size());
+    mix(&size, sizeof(size));
+    mix(&mtime, sizeof(mtime));
+    mix(&kMaskDictFormat, sizeof(kMaskDictFormat));
+    char name[64];
+    snprintf(name, sizeof(name), "/impala_mask_dict_%016llx.bin", static_cast<unsigned long long>(h));
+    return dir + name;
+}
+
+// 캐시 파일을 매핑합니다. 없거나, 이 프로세스의 사용자 소유가 아니거나, 원본과 맞지 않거나, 검증에 실패하면 false입니다.
+inline bool MapMaskDict(const std::string& cache_path, uint64_t source_size, int64_t source_mtime, MaskDict* dict) {
+    int fd = open(cache_path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_uid != geteuid() || st.st_size < static_cast<off_t>(sizeof(MaskDictHeader)) ||
+        st.st_size % sizeof(int32_t) != 0) {
+        close(fd);
+        return false;
+    }
+    size_t len = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    const int32_t* image = static_cast<const int32_t*>(map);
+    MaskDictHeader header;
+    memcpy(&header, image, sizeof(header));
+    if (header.source_size != source_size || header.source_mtime != source_mtime ||
+        !ValidateMaskDictImage(image, len / sizeof(int32_t))) {
+        munmap(map, len);
+        return false;
+    }
+    dict->AdoptMapping(map, len);
+    return true;
+}
+
+// 표를 임시 파일에 쓴 뒤 rename하므로, 동시에 같은 사전을 만드는 다른 프로세스는 완성된 파일만 봅니다.
+inline bool WriteMaskDictCache(const std::string& cache_path, const std::vector<int32_t>& image) {
+    static std::atomic<uint64_t> seq{0};
+    std::string tmp = cache_path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(seq.fetch_add(1));
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    const char* p = reinterpret_cast<const char*>(image.data());
+    size_t left = image.size() * sizeof(int32_t);
+    bool ok = true;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    if (close(fd) != 0) ok = false;
+    if (ok && rename(tmp.c_str(), cache_path.c_str()) == 0) return true;
+    unlink(tmp.c_str());
+    return false;
+}
+
+// 사전을 읽습니다. 같은 프로세스에서 이미 읽은 사전이 살아 있고 원본이 그대로이면 그것을 공유합니다.
+// 캐시 파일이 있으면 매핑하고, 없으면 단어 목록으로 만들어 캐시 파일에 쓴 뒤 매핑합니다.
+// 실패하면 nullptr을 반환하고 error에 원인을 담습니다.
+inline std::shared_ptr<const MaskDict> LoadMaskDict(const std::string& path, std::string* error) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        *error = "cannot open dictionary '" + path + "'";
+        return nullptr;
+    }
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::weak_ptr<const MaskDict>> loaded;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (auto shared = loaded[path].lock()) {
+        if (shared->source_size == size && shared->source_mtime == mtime) return shared;
+    }
+
+    std::shared_ptr<MaskDict> dict(new MaskDict());
+    std::string cache_path = MaskDictCachePath(path, size, mtime);
+    if (!MapMaskDict(cache_path, size, mtime, dict.get())) {
+        std::ifstream in(path);
+        if (!in.is_open()) {
+            *error = "cannot open dictionary '" + path + "'";
+            return nullptr;
+        }
+        std::vector<std::string> words;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) words.push_back(std::move(line));
+        }
+        std::vector<int32_t> image = BuildMaskDictImage(std::move(words), size, mtime);
+        // 캐시 디렉터리에 쓸 수 없으면 이 프로세스의 메모리에서만 씁니다.
+        if (!WriteMaskDictCache(cache_path, image) || !MapMaskDict(cache_path, size, mtime, dict.get())) {
+            dict->Own(std::move(image));
+        }
+    }
+    loaded[path] = dict;
+    return dict;
+}
+
+// 사전 오토마톤 스트림. DfaStream과 같은 방식으로 [이전 위치, end) 구간씩 이어서 처리하고,
+// 더 이상 다른 출현과 겹칠 수 없게 된 구간을 순서대로 fn(offset, length)로 넘깁니다.
+// simd가 false이면 루트에서 바이트를 건너뛸 때 SIMD 커널 대신 스칼라 루프를 씁니다.
+class MaskDictStream {
+public:
+    MaskDictStream(const MaskDict& dict, const uint8_t* base, bool simd = true)
+        : dict_(dict), base_(base), find_in_set_(simd ? GetMaskKernels().find_in_set : FindInSetScalar) {}
+
+    template <typename Fn>
+    void Feed(size_t end, Fn&& fn) {
+        while (pos_ < end) {
+            if (state_ == 0) {
+                // 루트에서는 단어를 시작할 수 없는 바이트를 건너뜁니다.
+                const uint8_t* p = find_in_set_(dict_.first_finder, base_ + pos_, base_ + end);
+                stats_.skipped += static_cast<size_t>(p - base_) - pos_;
+                pos_ = static_cast<size_t>(p - base_);
+                if (pos_ >= end) return;
+                ++stats_.attempts;
+            }
+            uint8_t c = base_[pos_++];
+            int32_t s = state_;
+            while (true) {
+                int32_t t = dict_.base[s] + c;
+                if (dict_.check[t] == s) {
+                    s = t;
+                    break;
+                }
+                if (s == 0) break;
+                s = dict_.fail[s];
+            }
+            state_ = s;
+
+            // 앞으로의 출현은 pos_ - depth 이후에서 시작하므로, 그 전에 끝나는 구간은 확정됩니다.
+            size_t floor = pos_ - static_cast<size_t>(dict_.depth[s]);
+            while (head_ < pending_.size() && pending_[head_].end <= floor) {
+                fn(pending_[head_].start, pending_[head_].end - pending_[head_].start);
+                ++head_;
+            }
+            if (head_ == pending_.size()) {
+                pending_.clear();
+                head_ = 0;
+            }
+            int32_t len = dict_.out_len[s];
+            if (len > 0) {
+                size_t start = pos_ - static_cast<size_t>(len);
+                while (pending_.size() > head_ && pending_.back().end > start) {
+                    start = std::min(start, pending_.back().start);
+                    pending_.pop_back();
+                }
+                pending_.push_back({start, pos_});
+            }
+        }
+    }
+
+    // 입력의 끝입니다. 남은 구간을 넘깁니다.
+    template <typename Fn>
+    void Finish(Fn&& fn) {
+        for (; head_ < pending_.size(); ++head_) {
+            fn(pending_[head_].start, pending_[head_].end - pending_[head_].start);
+        }
+        pending_.clear();
+        head_ = 0;
+    }
+
+    // 아직 넘기지 않은 구간은 모두 이 위치 이후에서 시작합니다. 확정되지 않은 구간이 있으면 그 시작이고(뒤의 출현과
+    // 합쳐질 수 있으므로 같은 단어가 겹쳐 이어지는 동안 계속 남습니다), 없으면 진행 중인 출현의 시작입니다.
+    size_t Committed() const {
+        size_t floor = pos_ - static_cast<size_t>(dict_.depth[state_]);
+        return head_ < pending_.size() ? std::min(floor, pending_[head_].start) : floor;
+    }
+
+    // 루트에서 건너뛰지 않은 바이트마다 전이 하나입니다.
+    MaskStreamStats stats() const {
+        MaskStreamStats stats = stats_;
+        stats.steps = pos_ - stats_.skipped;
+        return stats;
+    }
+
+private:
+    struct Pending {
+        size_t start;
+        size_t end;
+    };
+
+    const MaskDict& dict_;
+    const uint8_t* base_;
+    FindInSetFn find_in_set_;
+    MaskStreamStats stats_;
+    size_t pos_ = 0;
+    int32_t state_ = 0;
+    // 아직 확정되지 않은 구간 (시작 순, 서로 겹치지 않음). 보통 한두 개입니다.
+    std::vector<Pending> pending_;
+    size_t head_ = 0;
+};
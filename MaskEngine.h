@@ -0,0 +1,854 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "MaskAutomaton.h"
+#include "MaskBitNfa.h"
+#include "MaskBuiltin.h"
+#include "MaskCrypto.h"
+#include "MaskDict.h"
+#include "MaskFactors.h"
+#include "MaskLiteral.h"
+#include "MaskRules.h"
+
+// 규칙을 실행하는 엔진. CompileMaskRule의 플래너가 규칙마다 하나를 고릅니다.
+enum MaskEngineKind : uint8_t {
+    kEngineLiteral,  // 순수 리터럴: memmem
+    kEngineBitNfa,   // 위치가 kMaxBitNfaPositions 이하: 비트 병렬 NFA
+    kEngineDfa,      // 그 밖에 DFA로 컴파일할 수 있는 패턴
+    kEngineDict,     // DICT: 규칙의 Aho-Corasick 오토마톤
+    kEngineRegex,    // 캡처 그룹이나 지원하지 않는 문법: std::regex (백트래킹)
+};
+
+inline const char* MaskEngineName(MaskEngineKind engine) {
+    switch (engine) {
+        case kEngineLiteral: return "literal";
+        case kEngineBitNfa: return "bitnfa";
+        case kEngineDfa: return "dfa";
+        case kEngineDict: return "dict";
+        case kEngineRegex: return "regex";
+    }
+    return "unknown";
+}
+
+// 플래너가 고른 실행 계획과 그 근거. explain_rule()이 그대로 보여 줍니다.
+struct MaskRulePlan {
+    MaskEngineKind engine = kEngineRegex;
+    std::string reason;   // 이 엔진을 고른 이유
+    int positions = -1;   // Glushkov 위치 수. 비트 병렬 NFA에 담기지 않으면 -1
+    int dfa_states = -1;  // DFA 상태 수. DFA를 만들지 않았으면 -1
+};
+
+// 컴파일된 마스킹 규칙.
+// groups가 비어 있으면 매치 전체를, 아니면 재번호된 캡처 그룹만 마스킹합니다.
+// 엔진은 plan.engine이며, 그에 맞는 literal, bitnfa, dfa, dict 중 하나나 std::regex(re)를 사용합니다.
+struct CompiledRule {
+    std::string key;
+    int id = 0;  // MaskState 안에서 규칙별 카운터를 찾는 번호
+    std::regex re;
+    std::vector<int> groups;
+    MaskRulePlan plan;
+    std::unique_ptr<MaskLiteral> literal;
+    std::unique_ptr<MaskDfa> dfa;
+    std::unique_ptr<MaskBitNfa> bitnfa;
+    std::shared_ptr<const MaskDict> dict;  // 같은 단어 목록을 쓰는 규칙끼리 공유합니다.
+    int required_byte = -1;  // 모든 매치에 들어 있는 바이트 (행 사전 필터). 없으면 -1
+    std::vector<std::string> factors;  // 모든 매치가 그중 하나를 포함하는 리터럴 (MaskFactors.h). 없으면 비어 있음
+    std::unique_ptr<LiteralSetFinder> factor_finder;  // factors의 행 사전 필터. 필수 바이트로 충분하면 nullptr
+    uint32_t validators = 0;  // 매치 전체가 통과해야 하는 검증기 (MaskValidator 비트)
+    std::shared_ptr<const MaskDict> near_keywords;  // 매치 근처에 있어야 하는 키워드. 없으면 nullptr
+    size_t near_bytes = 0;
+};
+
+// 한 행을 처리한 결과
+struct MaskScanResult {
+    size_t matches = 0;        // 마스킹한 구간 수
+    bool prefiltered = false;  // 필수 바이트나 인자 리터럴이 없어 스캔을 건너뛰었는지
+    MaskStreamStats stream;    // 스트림 엔진의 스캔 통계 (std::regex 규칙은 0)
+};
+
+// 스캔에서 끄고 켤 수 있는 기능. 어느 조합이든 매치 결과는 같고 비용만 달라집니다.
+// mask()는 스레드마다 관찰한 통계로 이 값을 바꿉니다(MaskAdaptive.h).
+struct MaskScanOptions {
+    bool prefilter = true;  // 필수 바이트(memchr)나 인자 리터럴(Teddy)이 없는 행을 건너뜀
+    bool memo = true;       // 실패한 시도의 경로를 기록해 같은 경로의 다음 시도를 일찍 멈춤
+    bool simd = true;       // 첫 바이트 검색에 SIMD 커널 사용 (끄면 스칼라 루프)
+    bool validate = true;   // 규칙의 검증기 적용 (끄면 패턴 매치를 모두 넘김. fpe_unmask가 암호문을 찾을 때)
+};
+
+// 규칙에 행 사전 필터가 있는지
+inline bool MaskHasPrefilter(const CompiledRule& rule) {
+    return rule.factor_finder != nullptr || rule.required_byte >= 0;
+}
+
+// 인자 리터럴이나 필수 바이트가 입력에 없으면 매치가 있을 수 없으므로 false를 반환합니다.
+// 사전 필터를 끄면 항상 true입니다.
+inline bool MaskPrefilterPass(const CompiledRule& rule, const char* in, size_t len,
+                              const MaskScanOptions& options = MaskScanOptions()) {
+    if (!options.prefilter) return true;
+    if (rule.factor_finder != nullptr) return MaskLiteralsPresent(*rule.factor_finder, in, len);
+    return rule.required_byte < 0 || memchr(in, rule.required_byte, len) != nullptr;
+}
+
+// 패턴에 역참조(\1 등)가 있는지 검사합니다. 역참조가 있으면 그룹 번호를 바꿀 수 없습니다.
+inline bool HasBackReference(const std::string& pattern) {
+    bool in_class = false;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\') {
+            if (!in_class && i + 1 < pattern.size() && pattern[i + 1] >= '1' && pattern[i + 1] <= '9') return true;
+            ++i;
+        } else if (in_class) {
+            if (c == ']') in_class = false;
+        } else if (c == '[') {
+            in_class = true;
+        }
+    }
+    return false;
+}
+
+// 지정되지 않은 캡처 그룹을 비캡처 그룹 `(?:...)`으로 바꿉니다.
+// 엔진은 지정된 그룹의 부분 매치만 추적하게 되고, keep의 각 그룹은 새 번호를 renumbered에 받습니다.
+// 패턴에 없는 그룹 번호가 있으면 해당 자리는 0이 됩니다.
+inline std::string StripUnusedGroups(const std::string& pattern, const std::vector<int>& keep,
+                                     std::vector<int>* renumbered) {
+    std::string out;
+    out.reserve(pattern.size() + 16);
+    renumbered->assign(keep.size(), 0);
+    bool in_class = false;
+    int group = 0;
+    int kept = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        out += c;
+        if (c == '\\') {
+            if (i + 1 < pattern.size()) out += pattern[++i];
+        } else if (in_class) {
+            if (c == ']') in_class = false;
+        } else if (c == '[') {
+            in_class = true;
+        } else if (c == '(' && (i + 1 >= pattern.size() || pattern[i + 1] != '?')) {
+            ++group;
+            bool designated = false;
+            for (size_t k = 0; k < keep.size(); ++k) {
+                if (keep[k] == group) {
+                    if ((*renumbered)[k] == 0) (*renumbered)[k] = kept + 1;
+                    designated = true;
+                }
+            }
+            if (designated) {
+                ++kept;
+            } else {
+                out += "?:";
+            }
+        }
+    }
+    return out;
+}
+
+// 컴파일에 쓸 수 있는 비용의 상한. 규칙 파일의 규칙은 한 번만 컴파일하므로 기본값을 쓰고, 행마다 다른 패턴이
+// 올 수 있는 mask_regex()는 더 낮은 상한을 씁니다(MaskRegexCache.h).
+struct MaskCompileLimits {
+    int max_dfa_states = kMaxDfaStates;  // 넘으면 DFA 대신 std::regex로 처리합니다.
+    bool required_byte = true;           // 필수 바이트를 찾을지 (DFA에서는 상태 수 x 256 x 256 탐색)
+    bool regex = true;                   // std::regex로 처리해야 하는 규칙을 컴파일할지. 아니면 실패로 돌려줍니다.
+};
+
+// 규칙의 엔진을 고르고 컴파일합니다. 실패하면 nullptr을 반환하고 error에 원인을 담습니다.
+inline std::unique_ptr<CompiledRule> PlanMaskRule(const MaskRuleSpec& spec, std::string* error,
+                                                  const MaskCompileLimits& limits = MaskCompileLimits()) {
+    std::unique_ptr<CompiledRule> rule(new CompiledRule());
+    rule->key = spec.key;
+    rule->validators = spec.validators;
+    if (!spec.near_keywords.empty()) {
+        rule->near_keywords = MakeMaskDict(spec.near_keywords);
+        rule->near_bytes = spec.near_bytes;
+    }
+    MaskRulePlan& plan = rule->plan;
+    if (IsMaskDictRule(spec)) {
+        if (!spec.groups.empty()) {
+            *error = spec.key + ": DICT rules do not take capture groups";
+            return nullptr;
+        }
+        std::string reason;
+        rule->dict = LoadMaskDict(MaskDictPath(spec), &reason);
+        if (rule->dict == nullptr) {
+            *error = spec.key + ": " + reason;
+            return nullptr;
+        }
+        plan.engine = kEngineDict;
+        plan.reason = "word list";
+        return rule;
+    }
+    // 기본 규칙과 같은 패턴은 빌드 시점에 만들어 둔 표를 그대로 씁니다.
+    if (spec.groups.empty()) {
+        if (const MaskBuiltinDfa* builtin = FindBuiltinDfa(spec.pattern)) {
+            rule->dfa.reset(new MaskDfa());
+            rule->dfa->Attach(builtin->num_states, builtin->num_classes, builtin->stride_shift, builtin->start,
+                              builtin->accept_from, builtin->classes, builtin->next);
+            rule->required_byte = builtin->required_byte;
+            plan.engine = kEngineDfa;
+            plan.reason = "prebuilt table";
+            plan.dfa_states = builtin->num_states;
+            return rule;
+        }
+    }
+    // 플래너: 캡처 그룹이 필요 없는 규칙은 리터럴 검색, 비트 병렬 NFA, DFA 중 가장 먼저 만들 수 있는 것을 씁니다.
+    // 리터럴은 memmem 자체가 필터이므로 사전 필터를 두지 않고, 나머지는 필수 바이트를 사전 필터로 씁니다.
+    // 그룹 규칙은 std::regex로 실행하되, NFA나 DFA를 만들 수 있으면 필수 바이트만 가져옵니다.
+    if (spec.groups.empty()) {
+        std::unique_ptr<MaskLiteral> literal(new MaskLiteral());
+        if (BuildMaskLiteral(spec.pattern, literal.get())) {
+            rule->literal = std::move(literal);
+            plan.engine = kEngineLiteral;
+            plan.reason = "pure literal";
+            return rule;
+        }
+    }
+    std::unique_ptr<MaskBitNfa> bitnfa(new MaskBitNfa());
+    std::unique_ptr<MaskDfa> dfa(new MaskDfa());
+    std::string reason;
+    if (BuildMaskBitNfa(spec.pattern, bitnfa.get(), &reason)) {
+        if (limits.required_byte) rule->required_byte = FindRequiredByte(*bitnfa);
+        plan.positions = bitnfa->positions;
+        if (spec.groups.empty()) {
+            rule->bitnfa = std::move(bitnfa);
+            plan.engine = kEngineBitNfa;
+            plan.reason = std::to_string(plan.positions) + " positions fit one word";
+            return rule;
+        }
+    } else if (BuildMaskDfa(spec.pattern, dfa.get(), &reason, limits.max_dfa_states)) {
+        if (limits.required_byte) rule->required_byte = FindRequiredByte(*dfa);
+        plan.dfa_states = dfa->num_states;
+        if (spec.groups.empty()) {
+            rule->dfa = std::move(dfa);
+            plan.engine = kEngineDfa;
+            plan.reason = "more than " + std::to_string(kMaxBitNfaPositions) + " positions";
+            return rule;
+        }
+    }
+    plan.engine = kEngineRegex;
+    plan.reason = spec.groups.empty() ? reason : "capture groups";
+    if (!limits.regex) {
+        *error = spec.key + ": pattern needs backtracking (" + plan.reason + ")";
+        return nullptr;
+    }
+    try {
+        if (spec.groups.empty()) {
+            // 그룹을 쓰지 않는 규칙은 부분 매치를 전혀 저장하지 않도록 nosubs로 컴파일합니다.
+            auto flags = std::regex::ECMAScript;
+            if (!HasBackReference(spec.pattern)) flags |= std::regex::nosubs;
+            rule->re = std::regex(spec.pattern, flags);
+        } else if (HasBackReference(spec.pattern)) {
+            rule->re = std::regex(spec.pattern);
+            rule->groups = spec.groups;
+        } else {
+            rule->re = std::regex(StripUnusedGroups(spec.pattern, spec.groups, &rule->groups));
+        }
+    } catch (const std::regex_error& e) {
+        *error = spec.key + ": " + e.what();
+        return nullptr;
+    }
+    for (size_t k = 0; k < rule->groups.size(); ++k) {
+        if (rule->groups[k] <= 0 || static_cast<size_t>(rule->groups[k]) > rule->re.mark_count()) {
+            *error = spec.key + ": capture group " + std::to_string(spec.groups[k]) + " does not exist";
+            return nullptr;
+        }
+    }
+    return rule;
+}
+
+// 규칙의 인자 집합을 찾고 행 사전 필터를 정합니다. 패턴(리터럴 규칙은 리터럴, 사전 규칙은 단어가
+// kMaskMaxLiterals개 이하인 사전)과 근접 키워드 중 더 좋은 집합을 씁니다. 두 집합 모두 모든 매치에 필수입니다.
+// 리터럴 규칙은 memmem이 곧 필터이고, 인자가 한 바이트뿐이면 필수 바이트의 memchr로 충분하므로 표를 만들지 않습니다.
+inline void AttachMaskFactors(const MaskRuleSpec& spec, CompiledRule* rule) {
+    MaskFactorSet pattern;
+    if (rule->literal != nullptr) {
+        pattern.ok = true;
+        pattern.literals.push_back(rule->literal->bytes.substr(0, kMaskFactorBytes));
+    } else if (rule->dict != nullptr) {
+        std::vector<std::string> words;
+        pattern.ok = MaskDictWords(*rule->dict, kMaskMaxLiterals, &words) && MaskWordFactors(words, &pattern.literals);
+    } else {
+        pattern.ok = FindMaskFactors(spec.pattern, &pattern.literals);
+    }
+    MaskFactorSet keywords;
+    keywords.ok = !spec.near_keywords.empty() && MaskWordFactors(spec.near_keywords, &keywords.literals);
+    const MaskFactorSet& best = MaskFactorsBetter(keywords, pattern) ? keywords : pattern;
+    if (!MaskFactorsUsable(best)) return;
+    rule->factors = best.literals;
+    if (rule->plan.engine == kEngineLiteral) return;
+    bool single_byte = true;
+    for (const std::string& literal : best.literals) single_byte = single_byte && literal.size() == 1;
+    if (single_byte && rule->required_byte >= 0) return;
+    rule->factor_finder = BuildMaskFactorFinder(best.literals);
+}
+
+// 규칙을 컴파일합니다. 실패하면 nullptr을 반환하고 error에 원인을 담습니다.
+inline std::unique_ptr<CompiledRule> CompileMaskRule(const MaskRuleSpec& spec, std::string* error,
+                                                     const MaskCompileLimits& limits = MaskCompileLimits()) {
+    std::unique_ptr<CompiledRule> rule = PlanMaskRule(spec, error, limits);
+    if (rule != nullptr) AttachMaskFactors(spec, rule.get());
+    return rule;
+}
+
+// 컴파일된 규칙의 오토마톤이 차지하는 메모리 (바이트). std::regex의 내부 크기는 알 수 없어 리터럴, NFA, DFA와
+// 사전 표만 세고, 공유 라이브러리에 들어 있는 내장 규칙의 표는 세지 않습니다. 사전 표는 매핑한 캐시 파일의 크기입니다.
+inline size_t MaskRuleMemory(const CompiledRule& rule) {
+    if (rule.dict != nullptr) return rule.dict->Bytes();
+    if (rule.literal != nullptr) return rule.literal->Bytes();
+    if (rule.bitnfa != nullptr) return rule.bitnfa->Bytes();
+    if (rule.dfa == nullptr) return 0;
+    return sizeof(MaskDfa) + rule.dfa->storage.bytes();
+}
+
+// 규칙의 실행 계획을 한 줄로 만듭니다.
+//   explain rule=SSN engine=bitnfa prefilter=byte('-') positions=14 memory=6656 reason="14 positions fit one word"
+// 인자 리터럴 필터는 prefilter=literals(n=리터럴 수,min=가장 짧은 길이)입니다.
+inline std::string FormatMaskPlan(const CompiledRule& rule) {
+    const MaskRulePlan& plan = rule.plan;
+    char prefilter[32] = "none";
+    if (rule.factor_finder != nullptr) {
+        snprintf(prefilter, sizeof(prefilter), "literals(n=%zu,min=%zu)", rule.factor_finder->size(),
+                 rule.factor_finder->min_length);
+    } else if (rule.required_byte >= 0x21 && rule.required_byte < 0x7f && rule.required_byte != '\'' &&
+        rule.required_byte != '\\') {
+        snprintf(prefilter, sizeof(prefilter), "byte('%c')", rule.required_byte);
+    } else if (rule.required_byte >= 0) {
+        snprintf(prefilter, sizeof(prefilter), "byte(0x%02x)", rule.required_byte);
+    }
+    std::string line = "explain rule=" + rule.key + " engine=" + MaskEngineName(plan.engine);
+    line += std::string(" prefilter=") + prefilter;
+    if (plan.positions >= 0) line += " positions=" + std::to_string(plan.positions);
+    if (plan.dfa_states >= 0) line += " dfa_states=" + std::to_string(plan.dfa_states);
+    if (rule.dfa != nullptr) line += " byte_classes=" + std::to_string(rule.dfa->num_classes);
+    line += " memory=" + std::to_string(MaskRuleMemory(rule));
+    if (rule.validators != 0) line += " validated=yes";
+    if (rule.near_keywords != nullptr) line += " near=" + std::to_string(rule.near_bytes);
+    line += " reason=\"" + plan.reason + "\"";
+    return line;
+}
+
+// 매치 전체 [pos, pos + len)을 검증해 통과한 것만 fn에 넘기는 콜백. 검증기가 없는 규칙은 분기 하나입니다.
+template <typename Fn>
+struct ValidatedSpan {
+    uint32_t validators;
+    const char* begin;
+    Fn& fn;
+
+    void operator()(size_t pos, size_t len) const {
+        if (validators != 0 && !ValidateMaskMatch(validators, begin + pos, len)) return;
+        fn(pos, len);
+    }
+};
+
+template <typename Fn>
+ValidatedSpan<Fn> Validated(const CompiledRule& rule, const char* begin, Fn& fn, bool validate = true) {
+    return ValidatedSpan<Fn>{validate ? rule.validators : 0, begin, fn};
+}
+
+// 키워드 근접 조건. 키워드 구간과 패턴 매치가 각각 위치 순으로 들어오며, 매치 [s, e)는 시작이 e + bytes 이하이고
+// 끝이 s - bytes 이상인 키워드가 있을 때만 통과합니다. 키워드 스트림(MaskDictStream)은 서로 겹치는 출현을 한 구간으로
+// 합쳐 넘기므로 들어오는 구간은 겹치지 않고 끝도 위치 순입니다. 따라서 매치마다 "시작이 e + bytes 이하인 마지막
+// 키워드" 하나만 보면 되고, 그보다 앞의 키워드는 버립니다.
+class MaskNearFilter {
+public:
+    explicit MaskNearFilter(size_t bytes) : bytes_(bytes) {}
+
+    void OnKeyword(size_t pos, size_t len) { keywords_.push_back({pos, pos + len}); }
+    void OnMatch(size_t pos, size_t len) { matches_.push_back({pos, pos + len}); }
+
+    // 통과한 매치를 순서대로 fn에 넘기고, 통과하지 못한 매치는 버립니다. known 이전에 시작하는 키워드는 모두
+    // 들어왔다고 보고, 근처의 키워드가 아직 들어오지 않았을 수 있는 매치부터는 다음 호출로 미룹니다.
+    // final이면 모든 키워드가 들어온 것입니다.
+    template <typename Fn>
+    void Release(size_t known, bool final, Fn& fn) {
+        size_t m = 0;
+        for (; m < matches_.size(); ++m) {
+            const Range& match = matches_[m];
+            size_t limit = match.end + bytes_;
+            while (keyword_ + 1 < keywords_.size() && keywords_[keyword_ + 1].start <= limit) ++keyword_;
+            bool near = keyword_ < keywords_.size() && keywords_[keyword_].start <= limit &&
+                        keywords_[keyword_].end + bytes_ >= match.start;
+            if (near) {
+                fn(match.start, match.end - match.start);
+            } else if (!final && limit >= known) {
+                break;
+            }
+        }
+        matches_.erase(matches_.begin(), matches_.begin() + m);
+        keywords_.erase(keywords_.begin(), keywords_.begin() + keyword_);
+        keyword_ = 0;
+    }
+
+private:
+    struct Range {
+        size_t start;
+        size_t end;
+    };
+
+    size_t bytes_;
+    std::vector<Range> keywords_;
+    std::vector<Range> matches_;
+    size_t keyword_ = 0;
+};
+
+// 패턴 스트림과 키워드 스트림을 같은 구간씩 함께 진행하는 스트림. 입력은 한 번만 (청크 단위로) 지나갑니다.
+// 키워드 스트림은 겹치는 출현을 합친 구간이 끝날 때까지 넘기지 않으므로(`aaaa...`처럼 길게 이어질 수 있습니다),
+// 키워드 스트림이 알려 주는 확정 위치(Committed) 이전에 시작하는 키워드만 모두 들어온 것으로 봅니다.
+template <typename Inner>
+class MaskNearStream {
+public:
+    MaskNearStream(const CompiledRule& rule, Inner& inner, const uint8_t* base)
+        : inner_(inner), keywords_(*rule.near_keywords, base), filter_(rule.near_bytes) {}
+
+    template <typename Fn>
+    void Feed(size_t end, Fn&& fn) {
+        Run(end, [&](auto& stream, auto& on_span) { stream.Feed(end, on_span); });
+        filter_.Release(keywords_.Committed(), false, fn);
+    }
+
+    template <typename Fn>
+    void Finish(Fn&& fn) {
+        Run(end_, [&](auto& stream, auto& on_span) { stream.Finish(on_span); });
+        filter_.Release(end_, true, fn);
+    }
+
+private:
+    template <typename Step>
+    void Run(size_t end, Step step) {
+        end_ = end;
+        auto on_keyword = [&](size_t pos, size_t len) { filter_.OnKeyword(pos, len); };
+        auto on_match = [&](size_t pos, size_t len) { filter_.OnMatch(pos, len); };
+        step(keywords_, on_keyword);
+        step(inner_, on_match);
+    }
+
+    Inner& inner_;
+    MaskDictStream keywords_;
+    MaskNearFilter filter_;
+    size_t end_ = 0;
+};
+
+// 스트림의 매치를 검증기와 키워드 근접 조건으로 거른 뒤 fn에 넘깁니다. feed(stream, on_match)가 입력을 넘깁니다.
+template <typename Stream, typename Feed, typename Fn>
+void RunMaskStream(const CompiledRule& rule, Stream& stream, const char* begin, Feed feed, Fn& fn,
+                   const MaskScanOptions& options) {
+    auto on_match = Validated(rule, begin, fn, options.validate);
+    if (rule.near_keywords == nullptr) {
+        feed(stream, on_match);
+        return;
+    }
+    MaskNearStream<Stream> near(rule, stream, reinterpret_cast<const uint8_t*>(begin));
+    feed(near, on_match);
+}
+
+// 규칙의 엔진으로 begin에서 시작하는 입력의 스트림을 만들어 visit(stream)을 호출합니다.
+// 스트림으로 나눌 수 없는 std::regex 규칙이면 호출하지 않고 false를 반환합니다.
+template <typename Visit>
+bool VisitMaskStream(const CompiledRule& rule, const char* begin, const MaskScanOptions& options, Visit&& visit) {
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(begin);
+    switch (rule.plan.engine) {
+        case kEngineLiteral: {
+            MaskLiteralStream stream(*rule.literal, base);
+            visit(stream);
+            return true;
+        }
+        case kEngineBitNfa: {
+            MaskBitNfaStream stream(*rule.bitnfa, base, options.memo, options.simd);
+            visit(stream);
+            return true;
+        }
+        case kEngineDfa: {
+            DfaStream stream(*rule.dfa, base, options.memo, options.simd);
+            visit(stream);
+            return true;
+        }
+        case kEngineDict: {
+            MaskDictStream stream(*rule.dict, base, options.simd);
+            visit(stream);
+            return true;
+        }
+        case kEngineRegex:
+            break;
+    }
+    return false;
+}
+
+// 입력에서 마스킹할 구간을 앞에서부터 차례로 fn(offset, length)로 넘깁니다.
+// 구간은 서로 겹치지 않고 offset 순으로 정렬되어 있습니다. 검증기나 키워드 근접 조건을 통과하지 못한 매치는
+// 건너뜁니다. stats가 있으면 스트림 엔진의 스캔 통계를 담습니다.
+template <typename Fn>
+void ForEachMaskSpan(const CompiledRule& rule, const char* begin, const char* end, Fn&& fn,
+                     const MaskScanOptions& options = MaskScanOptions(), MaskStreamStats* stats = nullptr) {
+    size_t len = static_cast<size_t>(end - begin);
+    auto feed = [&](auto& stream, auto& on_match) {
+        stream.Feed(len, on_match);
+        stream.Finish(on_match);
+    };
+    auto run = [&](auto& stream) {
+        RunMaskStream(rule, stream, begin, feed, fn, options);
+        if (stats != nullptr) *stats = stream.stats();
+    };
+    if (VisitMaskStream(rule, begin, options, run)) return;
+
+    // std::regex는 스트림으로 나눌 수 없으므로 키워드를 먼저 모두 찾아 둡니다.
+    MaskNearFilter near(rule.near_bytes);
+    if (rule.near_keywords != nullptr) {
+        MaskDictStream keywords(*rule.near_keywords, reinterpret_cast<const uint8_t*>(begin));
+        auto on_keyword = [&](size_t pos, size_t n) { near.OnKeyword(pos, n); };
+        feed(keywords, on_keyword);
+    }
+
+    std::cregex_iterator it(begin, end, rule.re);
+    std::cregex_iterator last;
+    for (; it != last; ++it) {
+        const std::cmatch& m = *it;
+        if (options.validate && rule.validators != 0 &&
+            !ValidateMaskMatch(rule.validators, m[0].first, static_cast<size_t>(m.length(0)))) {
+            continue;
+        }
+        if (rule.near_keywords != nullptr) {
+            bool found = false;
+            auto on_near = [&](size_t, size_t) { found = true; };
+            near.OnMatch(static_cast<size_t>(m[0].first - begin), static_cast<size_t>(m.length(0)));
+            near.Release(len, true, on_near);
+            if (!found) continue;
+        }
+        if (rule.groups.empty()) {
+            fn(static_cast<size_t>(m[0].first - begin), static_cast<size_t>(m.length(0)));
+            continue;
+        }
+
+        // 지정된 그룹의 구간을 시작 위치 순으로 정렬하고 겹치는 구간은 합칩니다.
+        size_t starts[kMaxMaskGroups];
+        size_t ends[kMaxMaskGroups];
+        int n = 0;
+        for (int group : rule.groups) {
+            if (!m[group].matched || m.length(group) == 0) continue;
+            size_t s = static_cast<size_t>(m[group].first - begin);
+            size_t e = s + static_cast<size_t>(m.length(group));
+            int j = n++;
+            for (; j > 0 && starts[j - 1] > s; --j) {
+                starts[j] = starts[j - 1];
+                ends[j] = ends[j - 1];
+            }
+            starts[j] = s;
+            ends[j] = e;
+        }
+        for (int i = 0; i < n; ++i) {
+            size_t s = starts[i];
+            size_t e = ends[i];
+            while (i + 1 < n && starts[i + 1] <= e) {
+                if (ends[i + 1] > e) e = ends[i + 1];
+                ++i;
+            }
+            fn(s, e - s);
+        }
+    }
+}
+
+// 마스킹 구간을 mask_char로 바꾼 결과를 out 뒤에 덧붙입니다.
+inline void MaskAppend(const CompiledRule& rule, const char* begin, const char* end, char mask_char,
+                       std::string* out) {
+    if (!MaskPrefilterPass(rule, begin, static_cast<size_t>(end - begin))) {
+        out->append(begin, end);
+        return;
+    }
+    size_t last = 0;
+    ForEachMaskSpan(rule, begin, end, [&](size_t pos, size_t len) {
+        out->append(begin + last, pos - last);
+        out->append(len, mask_char);
+        last = pos + len;
+    });
+    out->append(begin + last, end);
+}
+
+// 마스킹 구간을 채우는 정책. MaskIntoWith의 템플릿 인자로 넘겨 행마다 분기 없이 인라인되게 합니다.
+// 채우기는 memset이며, glibc가 CPU에 맞는 SIMD 구현을 고릅니다.
+template <char C>
+struct ConstByteFill {
+    void operator()(char* out, size_t n) const { memset(out, C, n); }
+};
+
+struct ByteFill {
+    char c;
+    void operator()(char* out, size_t n) const { memset(out, c, n); }
+};
+
+// 배치 입력 한 행
+struct MaskBytes {
+    const char* ptr;
+    size_t len;
+};
+
+// 한 행에서 한 번에 복사하고 스캔하는 바이트 수. 복사한 바이트가 캐시에 있을 때 바로 스캔합니다.
+constexpr size_t kMaskStep = 4096;
+
+// 입력을 kMaskStep 바이트씩 out에 복사하면서 바로 스트림에 넘깁니다.
+template <typename Stream, typename Fn>
+void MaskStepped(Stream& stream, const MaskBytes& input, char* output, Fn& on_span) {
+    for (size_t pos = 0; pos < input.len; pos += kMaskStep) {
+        size_t step_end = std::min(input.len, pos + kMaskStep);
+        memcpy(output + pos, input.ptr + pos, step_end - pos);
+        stream.Feed(step_end, on_span);
+    }
+    stream.Finish(on_span);
+}
+
+// 여러 행을 한 번에 마스킹합니다. 행 i의 결과는 in[i].len 바이트 크기의 out[i]에 바로 쓰고,
+// 행마다의 매치 수와 사전 필터 여부는 results[i]에 담습니다.
+// 규칙 조회와 인자 검사는 호출하는 쪽에서 배치마다 한 번만 하고, 여기서는 행마다 사전 필터와 스캔만 합니다.
+template <typename Fill>
+void MaskBatchWith(const CompiledRule& rule, const MaskBytes* in, char* const* out, size_t n,
+                   MaskScanResult* results, Fill fill, const MaskScanOptions& options = MaskScanOptions()) {
+    for (size_t i = 0; i < n; ++i) {
+        const MaskBytes& input = in[i];
+        char* output = out[i];
+        MaskScanResult& result = results[i];
+        result = MaskScanResult();
+        if (!MaskPrefilterPass(rule, input.ptr, input.len, options)) {
+            memcpy(output, input.ptr, input.len);
+            result.prefiltered = true;
+            continue;
+        }
+        auto on_span = [&](size_t pos, size_t len) {
+            fill(output + pos, len);
+            ++result.matches;
+        };
+        auto feed = [&](auto& stream, auto& on_match) { MaskStepped(stream, input, output, on_match); };
+        auto run = [&](auto& stream) {
+            RunMaskStream(rule, stream, input.ptr, feed, on_span, options);
+            result.stream = stream.stats();
+        };
+        if (!VisitMaskStream(rule, input.ptr, options, run)) {
+            memcpy(output, input.ptr, input.len);
+            ForEachMaskSpan(rule, input.ptr, input.ptr + input.len, on_span, options);
+        }
+    }
+}
+
+inline void MaskBatch(const CompiledRule& rule, const MaskBytes* in, char* const* out, size_t n, char mask_char,
+                      MaskScanResult* results) {
+    MaskBatchWith(rule, in, out, n, results, ByteFill{mask_char});
+}
+
+// 마스킹 구간을 fill로 채운 결과를 len 바이트 크기의 out에 바로 씁니다. 한 행짜리 배치입니다.
+template <typename Fill>
+MaskScanResult MaskIntoWith(const CompiledRule& rule, const char* in, size_t len, char* out, Fill fill,
+                            const MaskScanOptions& options = MaskScanOptions()) {
+    MaskBytes input{in, len};
+    MaskScanResult result;
+    MaskBatchWith(rule, &input, &out, 1, &result, fill, options);
+    return result;
+}
+
+// 마스킹 구간을 mask_char로 바꾼 결과를 len 바이트 크기의 out에 바로 씁니다.
+inline MaskScanResult MaskInto(const CompiledRule& rule, const char* in, size_t len, char mask_char, char* out) {
+    return MaskIntoWith(rule, in, len, out, ByteFill{mask_char});
+}
+
+// UTF-8 선두 바이트로 문자의 바이트 수를 구합니다. 잘못된 선두 바이트면 0입니다.
+inline size_t Utf8CharLength(uint8_t lead) {
+    if (lead < 0x80) return 1;
+    if ((lead & 0xE0) == 0xC0) return 2;
+    if ((lead & 0xF0) == 0xE0) return 3;
+    if ((lead & 0xF8) == 0xF0) return 4;
+    return 0;
+}
+
+inline bool IsSingleUtf8Char(const uint8_t* p, size_t len) {
+    if (len == 0 || Utf8CharLength(p[0]) != len) return false;
+    for (size_t i = 1; i < len; ++i) {
+        if ((p[i] & 0xC0) != 0x80) return false;
+    }
+    return true;
+}
+
+// 마스킹 구간 하나 (입력 안의 위치와 길이)
+struct MaskSpan {
+    size_t pos;
+    size_t len;
+};
+
+// 사전 필터와 스캔으로 찾은 비어 있지 않은 마스킹 구간을 spans 뒤에 덧붙입니다.
+// 길이가 바뀌는 치환(멀티바이트 마스크, 토큰)은 이 구간들로 결과 크기를 먼저 계산해 한 번만 할당합니다.
+inline MaskScanResult CollectMaskSpans(const CompiledRule& rule, const char* in, size_t len,
+                                       std::vector<MaskSpan>* spans,
+                                       const MaskScanOptions& options = MaskScanOptions()) {
+    MaskScanResult result;
+    if (!MaskPrefilterPass(rule, in, len, options)) {
+        result.prefiltered = true;
+        return result;
+    }
+    auto on_span = [&](size_t pos, size_t n) {
+        if (n == 0) return;
+        spans->push_back({pos, n});
+        ++result.matches;
+    };
+    ForEachMaskSpan(rule, in, in + len, on_span, options, &result.stream);
+    return result;
+}
+
+// 구간 밖은 그대로 복사하고 구간마다 replace(span, out)이 쓴 바이트로 바꿉니다. 쓴 끝 위치를 반환합니다.
+template <typename Replace>
+char* WriteReplacedSpans(const char* in, size_t len, const MaskSpan* spans, size_t count, char* out,
+                         Replace replace) {
+    size_t last = 0;
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(out, in + last, spans[i].pos - last);
+        out = replace(spans[i], out + (spans[i].pos - last));
+        last = spans[i].pos + spans[i].len;
+    }
+    memcpy(out, in + last, len - last);
+    return out + (len - last);
+}
+
+// 구간 안의 UTF-8 문자 수. 구간이 문자 중간에서 시작해도 최소 한 문자로 셉니다.
+inline size_t Utf8CharCount(const char* p, size_t len) {
+    size_t chars = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if ((static_cast<uint8_t>(p[i]) & 0xC0) != 0x80) ++chars;
+    }
+    return chars == 0 && len != 0 ? 1 : chars;
+}
+
+// 마스킹 구간의 문자 하나하나를 멀티바이트 마스크 문자(예: "●")로 바꾼 결과의 크기와 내용.
+// 바이트가 아니라 UTF-8 문자 단위로 바꾸므로 "홍길동"은 "●●●"이 됩니다.
+inline size_t MaskUtf8Size(const char* in, size_t len, const MaskSpan* spans, size_t count, size_t mask_len) {
+    size_t size = len;
+    for (size_t i = 0; i < count; ++i) {
+        size = size - spans[i].len + Utf8CharCount(in + spans[i].pos, spans[i].len) * mask_len;
+    }
+    return size;
+}
+
+inline char* WriteMaskUtf8(const char* in, size_t len, const MaskSpan* spans, size_t count, const char* mask,
+                           size_t mask_len, char* out) {
+    return WriteReplacedSpans(in, len, spans, count, out, [&](const MaskSpan& span, char* dst) {
+        size_t chars = Utf8CharCount(in + span.pos, span.len);
+        for (size_t c = 0; c < chars; ++c, dst += mask_len) memcpy(dst, mask, mask_len);
+        return dst;
+    });
+}
+
+// 마스킹 구간을 keyed hash 토큰(kMaskTokenLength 바이트)으로 바꾼 결과의 크기와 내용.
+// 같은 값은 같은 키에 대해 항상 같은 토큰이 되므로 마스킹된 값끼리 조인할 수 있습니다.
+inline size_t TokenizedSize(size_t len, const MaskSpan* spans, size_t count) {
+    size_t size = len;
+    for (size_t i = 0; i < count; ++i) size = size - spans[i].len + kMaskTokenLength;
+    return size;
+}
+
+inline char* WriteTokenized(const SipHashKey& key, const char* in, size_t len, const MaskSpan* spans, size_t count,
+                            char* out) {
+    return WriteReplacedSpans(in, len, spans, count, out, [&](const MaskSpan& span, char* dst) {
+        WriteMaskToken(key, in + span.pos, span.len, dst);
+        return dst + kMaskTokenLength;
+    });
+}
+
+// 마스킹 구간의 숫자를 FF1로 암호화(decrypt면 복호화)한 결과를 len 바이트 크기의 out에 바로 씁니다.
+// 길이와 구분자는 그대로 유지되고 숫자는 숫자로 바뀝니다. 한 행의 매치는 묶어서 라운드 단위로 처리합니다.
+// 숫자가 kFf1MinDigits개보다 적은 구간은 FF1의 최소 도메인(10^6)에 못 미치므로 암호화하지 않고 '*'로 가리며,
+// 복호화할 때는 그대로 둡니다(fpe_mask가 암호화하지 않은 구간입니다).
+// 구간에 숫자와 ASCII 구분자 외의 문자가 있거나 숫자가 kFf1MaxDigits개보다 많으면 false를 반환합니다.
+// 이때 out의 내용은 쓰지 말아야 합니다. 처리 결과는 result에 담습니다.
+// 검증기는 평문에만 적용합니다. 암호문은 검사 자리가 맞지 않으므로 복호화할 때는 패턴 매치를 모두 복호화한 뒤
+// 결과가 검증기를 통과하지 못한 구간은 원래대로 되돌립니다(fpe_mask가 검증에 실패해 그대로 둔 값입니다).
+inline bool FpeInto(const CompiledRule& rule, const char* in, size_t len, const Ff1Key& key, bool decrypt,
+                    char* out, MaskScanResult* result) {
+    constexpr int kBatch = 32;
+    const char* begin = in;
+    const char* end = in + len;
+    memcpy(out, in, len);
+    if (!MaskPrefilterPass(rule, in, len)) {
+        result->prefiltered = true;
+        return true;
+    }
+
+    Ff1Item items[kBatch];
+    size_t offsets[kBatch];
+    size_t lengths[kBatch];
+    int count = 0;
+    bool ok = true;
+
+    auto flush = [&]() {
+        Ff1Batch(key, decrypt, items, count);
+        char* dst = out;
+        for (int k = 0; k < count; ++k) {
+            // 오른쪽부터 뒤 절반(v자리), 앞 절반(u자리) 순으로 숫자 자리를 채웁니다.
+            int v = items[k].n - items[k].n / 2;
+            uint64_t b = items[k].b;
+            uint64_t a = items[k].a;
+            int written = 0;
+            for (size_t i = offsets[k] + lengths[k]; i-- > offsets[k];) {
+                if (dst[i] < '0' || dst[i] > '9') continue;
+                if (written++ < v) {
+                    dst[i] = static_cast<char>('0' + b % 10);
+                    b /= 10;
+                } else {
+                    dst[i] = static_cast<char>('0' + a % 10);
+                    a /= 10;
+                }
+            }
+            if (decrypt && rule.validators != 0 && !ValidateMaskMatch(rule.validators, dst + offsets[k], lengths[k])) {
+                memcpy(dst + offsets[k], begin + offsets[k], lengths[k]);
+                --result->matches;
+            }
+        }
+        count = 0;
+    };
+
+    MaskScanOptions options;
+    options.validate = !decrypt;
+    ForEachMaskSpan(rule, begin, end, [&](size_t pos, size_t len) {
+        if (!ok || len == 0) return;
+        int n = 0;
+        for (size_t i = pos; i < pos + len; ++i) {
+            unsigned char c = static_cast<unsigned char>(begin[i]);
+            if (c >= '0' && c <= '9') {
+                ++n;
+            } else if (c >= 0x80 || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+                ok = false;
+                return;
+            }
+        }
+        if (n > kFf1MaxDigits) {
+            ok = false;
+            return;
+        }
+        if (n < kFf1MinDigits) {
+            if (!decrypt) memset(out + pos, '*', len);
+            ++result->matches;
+            return;
+        }
+
+        Ff1Item& item = items[count];
+        item.a = 0;
+        item.b = 0;
+        item.n = n;
+        int u = n / 2;
+        int seen = 0;
+        for (size_t i = pos; i < pos + len; ++i) {
+            char c = begin[i];
+            if (c < '0' || c > '9') continue;
+            uint64_t& half = (seen++ < u) ? item.a : item.b;
+            half = half * 10 + static_cast<uint64_t>(c - '0');
+        }
+        offsets[count] = pos;
+        lengths[count] = len;
+        ++result->matches;
+        if (++count == kBatch) flush();
+    }, options);
+
+    if (!ok) return false;
+    flush();
+    return true;
+}
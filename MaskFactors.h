@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MaskAutomaton.h"
+#include "MaskDict.h"
+#include "MaskSimd.h"
+
+// 규칙의 필수 리터럴 인자(factor) 추출.
+//
+// 인자 집합은 "규칙의 모든 매치가 그중 하나를 부분 문자열로 포함하는" 리터럴의 집합입니다. 행에 집합의 리터럴이
+// 하나도 없으면 그 규칙은 매치할 수 없으므로, LiteralSetFinder(Teddy)로 행 전체를 건너뛸 수 있습니다.
+// 필수 바이트 하나(required_byte)와 달리 `CONFIDENTIAL|SECRET`처럼 대안마다 다른 리터럴이나 여러 바이트 인자도
+// 표현하며, 프로파일은 모든 규칙의 인자를 합쳐 한 번의 검색으로 행을 거릅니다.
+//
+// 구문 트리의 노드마다 두 집합을 계산합니다.
+//   exact    노드가 매치할 수 있는 문자열 전부 (유한하고 작을 때만)
+//   factors  노드의 모든 매치가 포함하는 리터럴 집합 (쓸 만한 것이 있을 때만)
+// 연결은 이웃한 exact 집합을 곱해 길게 이어 붙이고, 대안은 자식의 집합을 합칩니다. 리터럴은 kMaskFactorBytes
+// 바이트까지만 이어 붙입니다(부분 문자열도 여전히 필수이므로 더 길 필요가 없습니다).
+
+constexpr size_t kMaskFactorBytes = 8;
+// 한 바이트짜리 리터럴이 섞인 집합은 이 개수까지만 인자로 씁니다. \d처럼 흔한 바이트 집합은 행을 거의 거르지 못합니다.
+constexpr size_t kMaskMaxShortFactors = 8;
+
+struct MaskFactorSet {
+    bool ok = false;
+    std::vector<std::string> literals;
+};
+
+// 인자 집합으로 쓸 수 있는지 (빈 리터럴이 없고 개수 제한 안)
+inline bool MaskFactorsUsable(const MaskFactorSet& set) {
+    if (!set.ok || set.literals.empty() || set.literals.size() > kMaskMaxLiterals) return false;
+    size_t min_length = set.literals[0].size();
+    for (const std::string& literal : set.literals) min_length = std::min(min_length, literal.size());
+    return min_length >= 2 || (min_length == 1 && set.literals.size() <= kMaskMaxShortFactors);
+}
+
+// 더 좋은 인자 집합: 가장 짧은 리터럴이 긴 쪽, 같으면 리터럴이 적은 쪽, 그래도 같으면 다시 가장 짧은 리터럴이 긴 쪽.
+// 4바이트보다 긴 리터럴은 행을 거르는 정도가 거의 같으므로 처음 비교에서는 길이를 4까지만 봅니다
+// (`(?:Mr|Ms)\. [A-Z]`는 52개의 "Mr. A"...보다 "Mr. ", "Ms. " 두 개가 낫습니다).
+inline bool MaskFactorsBetter(const MaskFactorSet& a, const MaskFactorSet& b) {
+    if (!MaskFactorsUsable(a)) return false;
+    if (!MaskFactorsUsable(b)) return true;
+    auto shortest = [](const MaskFactorSet& set) {
+        size_t n = set.literals[0].size();
+        for (const std::string& literal : set.literals) n = std::min(n, literal.size());
+        return n;
+    };
+    size_t na = shortest(a), nb = shortest(b);
+    if (std::min<size_t>(na, 4) != std::min<size_t>(nb, 4)) return na > nb;
+    if (a.literals.size() != b.literals.size()) return a.literals.size() < b.literals.size();
+    return na > nb;
+}
+
+inline void NormalizeMaskFactors(MaskFactorSet* set) {
+    std::sort(set->literals.begin(), set->literals.end());
+    set->literals.erase(std::unique(set->literals.begin(), set->literals.end()), set->literals.end());
+}
+
+// 두 exact 집합의 곱. 개수나 길이가 제한을 넘으면 ok가 false입니다.
+inline MaskFactorSet MaskFactorProduct(const MaskFactorSet& a, const MaskFactorSet& b) {
+    MaskFactorSet out;
+    if (!a.ok || !b.ok || a.literals.size() * b.literals.size() > kMaskMaxLiterals) return out;
+    for (const std::string& x : a.literals) {
+        for (const std::string& y : b.literals) {
+            if (x.size() + y.size() > kMaskFactorBytes) return out;
+            out.literals.push_back(x + y);
+        }
+    }
+    out.ok = true;
+    NormalizeMaskFactors(&out);
+    return out;
+}
+
+class MaskFactorExtractor {
+public:
+    struct Info {
+        MaskFactorSet exact;
+        MaskFactorSet factors;
+    };
+
+    Info Visit(const RegexNode& node) {
+        Info info;
+        switch (node.kind) {
+            case RegexNode::kEmpty:
+                info.exact.ok = true;
+                info.exact.literals.push_back(std::string());
+                break;
+            case RegexNode::kSet: {
+                info.exact.ok = true;
+                for (int b = 0; b < 256 && info.exact.ok; ++b) {
+                    if (!node.set.Has(static_cast<uint8_t>(b))) continue;
+                    info.exact.literals.push_back(std::string(1, static_cast<char>(b)));
+                    if (info.exact.literals.size() > kMaskMaxLiterals) info.exact = MaskFactorSet();
+                }
+                break;
+            }
+            case RegexNode::kConcat: {
+                std::vector<Info> children;
+                for (const auto& child : node.children) children.push_back(Visit(*child));
+                info = Concat(children);
+                break;
+            }
+            case RegexNode::kRepeat: {
+                Info child = Visit(*node.children[0]);
+                // 유한한 반복은 반복 횟수마다의 곱을 합친 것이 exact입니다.
+                if (node.max >= 0 && child.exact.ok) {
+                    MaskFactorSet power;
+                    power.ok = true;
+                    power.literals.push_back(std::string());
+                    info.exact.ok = true;
+                    for (int k = 0; info.exact.ok; ++k) {
+                        if (k >= node.min) {
+                            info.exact.literals.insert(info.exact.literals.end(), power.literals.begin(),
+                                                       power.literals.end());
+                            NormalizeMaskFactors(&info.exact);
+                            if (info.exact.literals.size() > kMaskMaxLiterals) info.exact = MaskFactorSet();
+                        }
+                        if (k == node.max) break;
+                        power = MaskFactorProduct(power, child.exact);
+                        if (!power.ok) info.exact = MaskFactorSet();
+                    }
+                }
+                // 한 번 이상 반복하면 최소 횟수만큼 이어 붙인 것이 모든 매치에 들어 있습니다.
+                if (node.min >= 1) {
+                    int copies = std::min(node.min, static_cast<int>(kMaskFactorBytes) + 1);
+                    info.factors = Concat(std::vector<Info>(copies, child)).factors;
+                }
+                break;
+            }
+            case RegexNode::kAlternate: {
+                info.exact.ok = true;
+                info.factors.ok = true;
+                for (const auto& child : node.children) {
+                    Info c = Visit(*child);
+                    if (info.exact.ok && c.exact.ok) {
+                        info.exact.literals.insert(info.exact.literals.end(), c.exact.literals.begin(),
+                                                   c.exact.literals.end());
+                        NormalizeMaskFactors(&info.exact);
+                        if (info.exact.literals.size() > kMaskMaxLiterals) info.exact = MaskFactorSet();
+                    } else {
+                        info.exact = MaskFactorSet();
+                    }
+                    if (info.factors.ok && MaskFactorsUsable(c.factors)) {
+                        info.factors.literals.insert(info.factors.literals.end(), c.factors.literals.begin(),
+                                                     c.factors.literals.end());
+                        NormalizeMaskFactors(&info.factors);
+                    } else {
+                        info.factors = MaskFactorSet();
+                    }
+                }
+                break;
+            }
+        }
+        if (MaskFactorsBetter(info.exact, info.factors)) info.factors = info.exact;
+        return info;
+    }
+
+private:
+    // 이웃한 exact 집합을 곱해 가며 이어 붙이고, 이어지지 않는 곳마다 그때까지의 곱과 자식의 인자를 후보로 봅니다.
+    static Info Concat(const std::vector<Info>& children) {
+        Info info;
+        MaskFactorSet run;
+        run.ok = true;
+        run.literals.push_back(std::string());
+        bool whole = true;
+        auto consider = [&](const MaskFactorSet& candidate) {
+            if (MaskFactorsBetter(candidate, info.factors)) info.factors = candidate;
+        };
+        for (const Info& child : children) {
+            // 곱의 앞부분도 모든 매치에 들어 있으므로, 이어 붙이기 전의 곱도 후보입니다.
+            consider(run);
+            MaskFactorSet next = MaskFactorProduct(run, child.exact);
+            if (next.ok) {
+                run = std::move(next);
+                continue;
+            }
+            whole = false;
+            consider(child.factors);
+            if (child.exact.ok) {
+                run = child.exact;
+            } else {
+                run.literals.assign(1, std::string());
+            }
+        }
+        consider(run);
+        if (whole) info.exact = run;
+        return info;
+    }
+};
+
+// 패턴의 인자 집합을 찾습니다. 지원하지 않는 문법이거나 쓸 만한 집합이 없으면 false입니다.
+inline bool FindMaskFactors(const std::string& pattern, std::vector<std::string>* factors) {
+    std::string reason;
+    std::unique_ptr<RegexNode> root = RegexParser(pattern).Parse(&reason);
+    if (root == nullptr) return false;
+    MaskFactorSet set = MaskFactorExtractor().Visit(*root).factors;
+    if (!MaskFactorsUsable(set)) return false;
+    *factors = std::move(set.literals);
+    return true;
+}
+
+// 단어 목록(사전 규칙, 근접 키워드)의 인자 집합. 단어마다 앞 kMaskFactorBytes 바이트를 씁니다.
+inline bool MaskWordFactors(const std::vector<std::string>& words, std::vector<std::string>* factors) {
+    MaskFactorSet set;
+    set.ok = true;
+    for (const std::string& word : words) set.literals.push_back(word.substr(0, kMaskFactorBytes));
+    NormalizeMaskFactors(&set);
+    if (!MaskFactorsUsable(set)) return false;
+    *factors = std::move(set.literals);
+    return true;
+}
+
+// 리터럴 집합의 리터럴 하나라도 입력에 있는지
+inline bool MaskLiteralsPresent(const LiteralSetFinder& finder, const char* in, size_t len) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(in);
+    return GetMaskKernels().find_literals(finder, p, p + len) != p + len;
+}
+
+// 인자 리터럴로 검색 표를 만듭니다. 한 리터럴이 다른 리터럴을 포함하면 짧은 쪽만 남깁니다.
+inline std::unique_ptr<LiteralSetFinder> BuildMaskFactorFinder(std::vector<std::string> literals) {
+    std::sort(literals.begin(), literals.end(), [](const std::string& a, const std::string& b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+    std::vector<std::string> kept;
+    for (const std::string& literal : literals) {
+        bool covered = false;
+        for (const std::string& shorter : kept) covered = covered || literal.find(shorter) != std::string::npos;
+        if (!covered) kept.push_back(literal);
+    }
+    std::unique_ptr<LiteralSetFinder> finder(new LiteralSetFinder());
+    if (!finder->Build(std::move(kept))) return nullptr;
+    return finder;
+}
@@ -0,0 +1,60 @@
+// 기본 규칙(DefaultMaskRules)을 DFA로 컴파일해 MaskBuiltinRules.inc를 생성합니다.
+//
+//   g++ -O2 -std=c++17 -o mask_gen MaskGen.cc && ./mask_gen > MaskBuiltinRules.inc
+//
+// 기본 규칙이나 DFA 표의 형식(kMaskDfaFormat)을 바꾸면 다시 생성해야 합니다.
+// 생성된 파일은 저장소에 함께 두므로 UDF 빌드에는 이 단계가 필요하지 않습니다.
+
+#include <cstdio>
+#include <string>
+
+#include "MaskAutomaton.h"
+#include "MaskRules.h"
+
+std::string CStringLiteral(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '\\' || c == '"') out.push_back('\\');
+        out.push_back(c);
+    }
+    return out + "\"";
+}
+
+int main() {
+    printf("// 자동 생성 파일입니다. 직접 고치지 말고 mask_gen(MaskGen.cc)으로 다시 생성하세요.\n\n");
+    printf("static_assert(kMaskDfaFormat == %d, \"MaskBuiltinRules.inc is stale; regenerate it with mask_gen\");\n",
+           kMaskDfaFormat);
+
+    std::vector<std::string> entries;
+    int index = 0;
+    for (const MaskRuleSpec& spec : DefaultMaskRules()) {
+        if (!spec.groups.empty()) continue;
+        MaskDfa dfa;
+        std::string reason;
+        if (!BuildMaskDfa(spec.pattern, &dfa, &reason)) {
+            fprintf(stderr, "%s: %s (left to the runtime compiler)\n", spec.key.c_str(), reason.c_str());
+            continue;
+        }
+
+        printf("\n// %s: %s\n", spec.key.c_str(), spec.pattern.c_str());
+        printf("alignas(64) inline constexpr uint8_t kBuiltinDfa%dClasses[] = {", index);
+        for (int b = 0; b < 256; ++b) printf("%s%d,", b % 16 == 0 ? "\n    " : " ", dfa.classes[b]);
+        printf("\n};\n");
+        printf("alignas(64) inline constexpr int32_t kBuiltinDfa%dNext[] = {", index);
+        size_t entries_in_table = static_cast<size_t>(dfa.num_states) << dfa.stride_shift;
+        for (size_t i = 0; i < entries_in_table; ++i) printf("%s%d,", i % 16 == 0 ? "\n    " : " ", dfa.next[i]);
+        printf("\n};\n");
+
+        std::string name = "kBuiltinDfa" + std::to_string(index);
+        entries.push_back("    {" + CStringLiteral(spec.pattern) + ", " + std::to_string(dfa.num_states) + ", " +
+                          std::to_string(dfa.num_classes) + ", " + std::to_string(dfa.stride_shift) + ", " +
+                          std::to_string(dfa.start) + ", " + std::to_string(dfa.accept_from) + ", " + name +
+                          "Classes, " + name + "Next, " + std::to_string(FindRequiredByte(dfa)) + "},");
+        ++index;
+    }
+
+    printf("\ninline constexpr MaskBuiltinDfa kMaskBuiltinDfas[] = {\n");
+    for (const std::string& entry : entries) printf("%s\n", entry.c_str());
+    printf("};\n");
+    return 0;
+}
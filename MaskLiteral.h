@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "MaskAutomaton.h"
+
+// 순수 리터럴 규칙(메타 문자가 없는 패턴, 예: `CONFIDENTIAL`)의 검색.
+//
+// 매치는 리터럴의 겹치지 않는 출현을 앞에서부터 찾은 것이며, 리터럴 하나의 leftmost-longest 매치와 같습니다.
+// 검색은 memmem이므로 glibc가 CPU에 맞는 SIMD 구현을 고릅니다. 오토마톤 표가 없습니다.
+
+struct MaskLiteral {
+    std::string bytes;
+
+    size_t Bytes() const { return sizeof(MaskLiteral) + bytes.capacity(); }
+};
+
+// 구문 트리가 바이트 하나짜리 집합의 연결(고정 횟수 반복 포함)이면 그 바이트열을 literal에 담고 true를 반환합니다.
+inline bool RegexLiteral(const RegexNode& node, std::string* literal) {
+    switch (node.kind) {
+        case RegexNode::kEmpty:
+            return true;
+        case RegexNode::kSet: {
+            int byte = -1;
+            for (int b = 0; b < 256; ++b) {
+                if (!node.set.Has(static_cast<uint8_t>(b))) continue;
+                if (byte >= 0) return false;
+                byte = b;
+            }
+            if (byte < 0) return false;
+            literal->push_back(static_cast<char>(byte));
+            return true;
+        }
+        case RegexNode::kConcat:
+            for (const auto& child : node.children) {
+                if (!RegexLiteral(*child, literal)) return false;
+            }
+            return true;
+        case RegexNode::kRepeat:
+            if (node.min != node.max) return false;
+            for (int i = 0; i < node.min; ++i) {
+                if (!RegexLiteral(*node.children[0], literal)) return false;
+            }
+            return true;
+        case RegexNode::kAlternate:
+            return false;
+    }
+    return false;
+}
+
+// 패턴이 비어 있지 않은 리터럴이면 literal에 컴파일하고 true를 반환합니다.
+inline bool BuildMaskLiteral(const std::string& pattern, MaskLiteral* literal) {
+    std::string reason;
+    std::unique_ptr<RegexNode> root = RegexParser(pattern).Parse(&reason);
+    if (root == nullptr) return false;
+    std::string bytes;
+    if (!RegexLiteral(*root, &bytes) || bytes.empty()) return false;
+    literal->bytes = std::move(bytes);
+    return true;
+}
+
+// 리터럴 스트림. DfaStream과 같은 방식으로 [이전 위치, end) 구간씩 이어서 처리합니다.
+// 출현은 찾는 즉시 확정되며, 청크 경계에 걸친 출현은 다음 Feed에서 리터럴 길이 - 1 바이트 앞부터 다시 찾습니다.
+class MaskLiteralStream {
+public:
+    MaskLiteralStream(const MaskLiteral& literal, const uint8_t* base)
+        : needle_(literal.bytes.data()), len_(literal.bytes.size()), base_(base) {}
+
+    template <typename Fn>
+    void Feed(size_t end, Fn&& fn) {
+        while (pos_ < end && end - pos_ >= len_) {
+            const void* hit = memmem(base_ + pos_, end - pos_, needle_, len_);
+            if (hit == nullptr) {
+                pos_ = end - len_ + 1;
+                return;
+            }
+            size_t start = static_cast<size_t>(static_cast<const uint8_t*>(hit) - base_);
+            fn(start, len_);
+            pos_ = start + len_;
+        }
+    }
+
+    // 입력의 끝입니다. 출현은 Feed에서 모두 넘겼으므로 남은 구간이 없습니다.
+    template <typename Fn>
+    void Finish(Fn&&) {}
+
+    // memmem에는 끄고 켤 기능이 없어 적응 제어용 통계를 세지 않습니다.
+    const MaskStreamStats& stats() const { return stats_; }
+
+private:
+    const char* needle_;
+    size_t len_;
+    const uint8_t* base_;
+    size_t pos_ = 0;
+    MaskStreamStats stats_;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MaskSimd.h"
+#include "MaskStats.h"
+
+// 노드(impalad 프로세스) 전체의 규칙별 지표. 프래그먼트가 끝날 때 합계를 더하고,
+// IMPALA_MASK_METRICS_FILE이 설정되어 있으면 Prometheus 텍스트 형식으로 파일에 씁니다.
+// 노드 익스포터(textfile collector)가 이 파일을 수집합니다.
+// 행 처리 경로는 스레드별 카운터만 건드리고, 이 레지스트리는 컴파일과 Close에서만 잠급니다.
+struct MaskNodeRuleMetrics {
+    MaskRuleCounters counters;
+    uint64_t compiles = 0;
+    uint64_t compile_ns = 0;
+    uint64_t automaton_bytes = 0;  // 가장 최근에 컴파일한 오토마톤 크기
+};
+
+inline std::string MaskMetricsPath() {
+    const char* env = std::getenv("IMPALA_MASK_METRICS_FILE");
+    return env != nullptr ? env : "";
+}
+
+// 파일을 다시 쓰는 최소 간격 (초). 기본 10초
+inline uint64_t MaskMetricsIntervalNs() {
+    const char* env = std::getenv("IMPALA_MASK_METRICS_INTERVAL");
+    long long seconds = env != nullptr ? std::atoll(env) : 10;
+    if (seconds < 0) seconds = 0;
+    return static_cast<uint64_t>(seconds) * 1000000000ull;
+}
+
+// Prometheus 레이블 값 이스케이프
+inline std::string MetricLabel(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+class MaskNodeMetrics {
+public:
+    // 프로세스에 하나뿐인 레지스트리. 같은 .so를 쓰는 모든 프래그먼트가 공유합니다.
+    static MaskNodeMetrics& Instance() {
+        static MaskNodeMetrics metrics;
+        return metrics;
+    }
+
+    void RecordCompile(const std::string& rule_key, uint64_t ns, size_t automaton_bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        MaskNodeRuleMetrics& rule = rules_[rule_key];
+        ++rule.compiles;
+        rule.compile_ns += ns;
+        rule.automaton_bytes = automaton_bytes;
+    }
+
+    // 끝난 프래그먼트의 규칙별 카운터를 더하고, 간격이 지났으면 지표 파일을 다시 씁니다.
+    void AddFragment(const std::vector<std::pair<std::string, MaskRuleCounters>>& rules) {
+        std::string path = MaskMetricsPath();
+        std::string text;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++fragments_;
+            for (const auto& rule : rules) rules_[rule.first].counters.Add(rule.second);
+            if (path.empty()) return;
+            uint64_t now = MaskNowNs();
+            if (last_write_ns_ != 0 && now - last_write_ns_ < MaskMetricsIntervalNs()) return;
+            last_write_ns_ = now;
+            text = FormatLocked();
+        }
+        WriteFile(path, text);
+    }
+
+private:
+    std::string FormatLocked() const {
+        std::string out;
+        char buf[256];
+        auto header = [&](const char* name, const char* type, const char* help) {
+            out += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+        };
+        auto sample = [&](const char* name, const std::string& rule_key, double value) {
+            snprintf(buf, sizeof(buf), "%.17g", value);
+            out += std::string(name) + "{rule=\"" + MetricLabel(rule_key) + "\"} " + buf + "\n";
+        };
+        auto family = [&](const char* name, const char* type, const char* help, auto value_of) {
+            header(name, type, help);
+            for (const auto& rule : rules_) sample(name, rule.first, value_of(rule.second));
+        };
+
+        header("impala_mask_kernel_info", "gauge", "SIMD kernel variant selected at load time.");
+        out += std::string("impala_mask_kernel_info{isa=\"") + GetMaskKernels().isa + "\"} 1\n";
+        header("impala_mask_fragments_total", "counter", "Fragments that closed a masking UDF.");
+        out += "impala_mask_fragments_total " + std::to_string(fragments_) + "\n";
+        family("impala_mask_rule_compiles_total", "counter", "Rule compilations.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.compiles); });
+        family("impala_mask_rule_compile_seconds_total", "counter", "Time spent compiling rules.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.compile_ns) / 1e9; });
+        family("impala_mask_rule_automaton_bytes", "gauge", "Size of the most recently compiled automaton.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.automaton_bytes); });
+        family("impala_mask_rows_total", "counter", "Rows evaluated.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.counters.rows); });
+        family("impala_mask_rows_skipped_total", "counter", "Rows skipped by the prefilter.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.counters.rows_skipped); });
+        family("impala_mask_rows_matched_total", "counter", "Rows with at least one match.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.counters.rows_matched); });
+        family("impala_mask_matches_total", "counter", "Masked spans.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.counters.matches); });
+        family("impala_mask_bytes_scanned_total", "counter", "Input bytes.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.counters.bytes_scanned); });
+        family("impala_mask_bytes_allocated_total", "counter", "Result bytes allocated.",
+               [](const MaskNodeRuleMetrics& m) { return static_cast<double>(m.counters.bytes_allocated); });
+        family("impala_mask_prefilter_skip_ratio", "gauge", "Fraction of rows skipped by the prefilter.",
+               [](const MaskNodeRuleMetrics& m) {
+                   return m.counters.rows == 0 ? 0.0
+                                               : static_cast<double>(m.counters.rows_skipped) /
+                                                     static_cast<double>(m.counters.rows);
+               });
+        return out;
+    }
+
+    // 수집기가 쓰다 만 파일을 읽지 않도록 임시 파일에 쓴 뒤 rename합니다.
+    // 다른 프래그먼트가 쓰는 중이면 이번 갱신은 건너뜁니다.
+    void WriteFile(const std::string& path, const std::string& text) {
+        std::unique_lock<std::mutex> lock(write_mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) return;
+        std::string tmp = path + ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return;
+        bool ok = write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size());
+        if (close(fd) != 0) ok = false;
+        if (ok) {
+            rename(tmp.c_str(), path.c_str());
+        } else {
+            unlink(tmp.c_str());
+        }
+    }
+
+    std::mutex mutex_;
+    std::mutex write_mutex_;
+    std::map<std::string, MaskNodeRuleMetrics> rules_;
+    uint64_t fragments_ = 0;
+    uint64_t last_write_ns_ = 0;
+};
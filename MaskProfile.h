@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "MaskEngine.h"
+
+// 프로파일(이름 붙은 규칙 묶음)을 입력 한 번의 스캔으로 적용합니다.
+//
+// 규칙마다 레인을 두고, 입력을 kMaskStep 바이트씩 (필요하면 결과 버퍼로 복사하면서) 모든 레인에 차례로 넘깁니다.
+// 청크가 캐시에 있는 동안 모든 규칙이 지나가므로 mask(mask(...))처럼 규칙마다 입력을 다시 읽고 결과를 다시
+// 할당하지 않습니다. 서로 겹치는 매치는 우선순위(프로파일에 적은 순서)가 높은 규칙의 것만 남깁니다.
+
+// 컴파일된 프로파일. 규칙은 MaskState가 소유하며 우선순위 순입니다.
+struct CompiledProfile {
+    std::string name;
+    int id = 0;  // MaskState 안에서 카운터를 찾는 번호 (규칙 id 다음부터)
+    std::vector<const CompiledRule*> rules;
+    std::unique_ptr<LiteralSetFinder> prefilter;  // 모든 규칙의 인자 리터럴. 없으면 nullptr
+};
+
+// 모든 규칙에 인자 집합이 있으면 그 합집합으로 프로파일의 행 사전 필터를 만듭니다. 행에 어느 리터럴도 없으면
+// 어떤 규칙도 매치할 수 없으므로, 레인마다 사전 필터를 돌리기 전에 리터럴 검색 한 번으로 행 전체를 건너뜁니다.
+// 인자가 없는 규칙이 하나라도 있거나 합집합이 kMaskMaxLiterals개를 넘으면 만들지 않습니다.
+inline void BuildMaskProfilePrefilter(CompiledProfile* profile) {
+    std::vector<std::string> literals;
+    for (const CompiledRule* rule : profile->rules) {
+        if (rule->factors.empty()) return;
+        literals.insert(literals.end(), rule->factors.begin(), rule->factors.end());
+    }
+    if (profile->rules.size() > 1) profile->prefilter = BuildMaskFactorFinder(std::move(literals));
+}
+
+// 프로파일의 매치 구간 하나와 그 구간을 낸 규칙 (프로파일 안의 순서)
+struct MaskProfileSpan {
+    size_t pos;
+    size_t len;
+    int rule;
+};
+
+// 규칙 하나를 청크 단위로 진행하는 레인. 스트림과 구간 버퍼를 행마다 다시 쓰므로, 버퍼가 충분히 커진 뒤에는
+// 할당하지 않습니다. std::regex 규칙은 나눠 처리할 수 없어 입력의 끝에서 한 번에 찾습니다.
+class MaskProfileLane {
+public:
+    explicit MaskProfileLane(const CompiledRule& rule) : rule_(rule) {}
+
+    std::vector<MaskSpan> spans;  // 이 행에서 찾은 구간 (위치 순)
+    bool prefiltered = false;
+
+    // skip이면 (프로파일 사전 필터가 행을 거른 경우) 규칙의 사전 필터도 돌리지 않고 건너뜁니다.
+    void Start(const char* base, size_t len, bool skip = false) {
+        base_ = base;
+        len_ = len;
+        spans.clear();
+        near_literal_.reset();
+        near_bitnfa_.reset();
+        near_dfa_.reset();
+        near_dict_.reset();
+        prefiltered = skip || !MaskPrefilterPass(rule_, base, len);
+        if (prefiltered) return;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(base);
+        if (rule_.literal != nullptr) {
+            literal_.emplace(*rule_.literal, bytes);
+            if (rule_.near_keywords != nullptr) near_literal_.emplace(rule_, *literal_, bytes);
+        } else if (rule_.bitnfa != nullptr) {
+            bitnfa_.emplace(*rule_.bitnfa, bytes);
+            if (rule_.near_keywords != nullptr) near_bitnfa_.emplace(rule_, *bitnfa_, bytes);
+        } else if (rule_.dfa != nullptr) {
+            dfa_.emplace(*rule_.dfa, bytes);
+            if (rule_.near_keywords != nullptr) near_dfa_.emplace(rule_, *dfa_, bytes);
+        } else if (rule_.dict != nullptr) {
+            dict_.emplace(*rule_.dict, bytes);
+            if (rule_.near_keywords != nullptr) near_dict_.emplace(rule_, *dict_, bytes);
+        }
+    }
+
+    void Feed(size_t end) {
+        if (!prefiltered) Drive([&](auto& stream, auto& sink) { stream.Feed(end, sink); });
+    }
+
+    void Finish() {
+        if (prefiltered) return;
+        if (rule_.plan.engine == kEngineRegex) {
+            ForEachMaskSpan(rule_, base_, base_ + len_, [&](size_t pos, size_t n) { Push(pos, n); });
+            return;
+        }
+        Drive([&](auto& stream, auto& sink) { stream.Finish(sink); });
+    }
+
+private:
+    void Push(size_t pos, size_t n) {
+        if (n != 0) spans.push_back({pos, n});
+    }
+
+    template <typename Step>
+    void Drive(Step step) {
+        auto push = [&](size_t pos, size_t n) { Push(pos, n); };
+        auto sink = Validated(rule_, base_, push);
+        if (near_literal_) {
+            step(*near_literal_, sink);
+        } else if (near_bitnfa_) {
+            step(*near_bitnfa_, sink);
+        } else if (near_dfa_) {
+            step(*near_dfa_, sink);
+        } else if (near_dict_) {
+            step(*near_dict_, sink);
+        } else if (literal_) {
+            step(*literal_, sink);
+        } else if (bitnfa_) {
+            step(*bitnfa_, sink);
+        } else if (dfa_) {
+            step(*dfa_, sink);
+        } else if (dict_) {
+            step(*dict_, sink);
+        }
+    }
+
+    const CompiledRule& rule_;
+    const char* base_ = nullptr;
+    size_t len_ = 0;
+    std::optional<MaskLiteralStream> literal_;
+    std::optional<MaskBitNfaStream> bitnfa_;
+    std::optional<DfaStream> dfa_;
+    std::optional<MaskDictStream> dict_;
+    std::optional<MaskNearStream<MaskLiteralStream>> near_literal_;
+    std::optional<MaskNearStream<MaskBitNfaStream>> near_bitnfa_;
+    std::optional<MaskNearStream<DfaStream>> near_dfa_;
+    std::optional<MaskNearStream<MaskDictStream>> near_dict_;
+};
+
+// 프로파일 하나의 스캐너. 스레드마다 하나씩 두고 행마다 다시 씁니다.
+class MaskProfileScanner {
+public:
+    explicit MaskProfileScanner(const CompiledProfile& profile) : profile_(profile) {
+        for (const CompiledRule* rule : profile.rules) lanes_.emplace_back(new MaskProfileLane(*rule));
+    }
+
+    const CompiledProfile& profile() const { return profile_; }
+
+    // 입력을 스캔해 우선순위로 겹침을 정리한 구간을 spans()에 담습니다. out이 있으면 입력을 len 바이트 크기의
+    // out에 청크 단위로 복사합니다(구간은 채우지 않음).
+    void Scan(const char* in, size_t len, char* out) {
+        bool skip = profile_.prefilter != nullptr && !MaskLiteralsPresent(*profile_.prefilter, in, len);
+        for (auto& lane : lanes_) lane->Start(in, len, skip);
+        for (size_t pos = 0; pos < len; pos += kMaskStep) {
+            size_t step_end = std::min(len, pos + kMaskStep);
+            if (out != nullptr) memcpy(out + pos, in + pos, step_end - pos);
+            for (auto& lane : lanes_) lane->Feed(step_end);
+        }
+        for (auto& lane : lanes_) lane->Finish();
+        Resolve();
+    }
+
+    // 위치 순이고 서로 겹치지 않는 구간
+    const std::vector<MaskProfileSpan>& spans() const { return spans_; }
+
+    // 모든 규칙이 사전 필터로 스캔을 건너뛰었는지
+    bool AllPrefiltered() const {
+        for (const auto& lane : lanes_) {
+            if (!lane->prefiltered) return false;
+        }
+        return true;
+    }
+
+private:
+    // 우선순위가 높은 규칙부터, 이미 남은 구간과 겹치지 않는 구간만 위치 순으로 끼워 넣습니다.
+    void Resolve() {
+        spans_.clear();
+        for (size_t r = 0; r < lanes_.size(); ++r) {
+            const std::vector<MaskSpan>& candidates = lanes_[r]->spans;
+            if (candidates.empty()) continue;
+            merged_.clear();
+            size_t i = 0;
+            for (const MaskSpan& span : candidates) {
+                while (i < spans_.size() && spans_[i].pos + spans_[i].len <= span.pos) merged_.push_back(spans_[i++]);
+                if (i < spans_.size() && spans_[i].pos < span.pos + span.len) continue;
+                merged_.push_back({span.pos, span.len, static_cast<int>(r)});
+            }
+            merged_.insert(merged_.end(), spans_.begin() + i, spans_.end());
+            spans_.swap(merged_);
+        }
+    }
+
+    const CompiledProfile& profile_;
+    std::vector<std::unique_ptr<MaskProfileLane>> lanes_;
+    std::vector<MaskProfileSpan> spans_;
+    std::vector<MaskProfileSpan> merged_;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MaskEngine.h"
+#include "MaskMetrics.h"
+#include "MaskStats.h"
+
+// mask_regex()의 임시(ad-hoc) 패턴 컴파일 캐시.
+//
+// 프로세스에 하나 두고 모든 프래그먼트가 공유합니다. 패턴의 64비트 해시로 kMaskRegexShards개의 샤드 중 하나를
+// 고르고, 샤드마다 최근에 쓴 kMaskRegexShardSlots개를 LRU로 둡니다. 샤드는 각자의 뮤텍스로만 보호하므로 서로 다른
+// 패턴의 조회끼리 경합하지 않으며, 컴파일은 잠금 밖에서 합니다. 항목은 shared_ptr로 넘기므로 샤드에서 밀려난
+// 항목도 쓰는 쪽이 놓을 때까지 살아 있습니다.
+// 행마다의 조회는 스레드 상태의 MaskRegexFront(해시로 칸을 정하는 작은 캐시)가 먼저 받아 잠금도 원자 연산도 없이
+// 끝나고, 그곳에 없을 때만 샤드를 잠급니다.
+//
+// 백트래킹(std::regex)이 필요한 패턴과 사전 규칙(`DICT:`)은 거절합니다. 받아들인 패턴은 리터럴, 비트 병렬 NFA, DFA 중 하나로 실행되어
+// 입력 길이에 선형이므로 ReDoS가 없습니다. 거절한 패턴도 원인과 함께 캐시해 행마다 다시 컴파일하지 않습니다.
+//
+// 캐시는 모두 kMaskRegexShards x kMaskRegexShardSlots(256)개이므로, 그보다 많은 서로 다른 패턴이 번갈아 오면
+// (예: 행마다 다른 패턴 컬럼) 대부분의 행이 컴파일로 끝납니다. 그래서 상수가 아닌 패턴은 더 싼 단계로
+// 컴파일합니다: DFA 상태를 kMaskRegexMaxDfaStates개까지만 만들고, 필수 바이트 탐색(DFA 상태 수 x 256 x 256)을
+// 하지 않습니다(행 사전 필터는 구문 트리에서 찾는 인자 리터럴로 합니다). 상수 패턴은 프래그먼트마다 한 번만
+// 컴파일하므로 규칙 파일의 규칙과 같은 상한을 씁니다.
+
+constexpr size_t kMaskRegexShards = 16;
+constexpr size_t kMaskRegexShardSlots = 16;
+constexpr size_t kMaskRegexFrontSlots = 16;
+constexpr size_t kMaskRegexMaxPattern = 4096;
+// 상수가 아닌 패턴의 DFA 상태 수 상한 (규칙 파일의 규칙은 kMaxDfaStates)
+constexpr int kMaskRegexMaxDfaStates = 512;
+// 프래그먼트마다 경고를 남기는 거절된 패턴의 최대 개수 (그 뒤로는 한 번만 더 알립니다)
+constexpr size_t kMaskRegexMaxWarnings = 16;
+
+// 컴파일한 패턴 하나. 만든 뒤에는 바꾸지 않으므로 여러 스레드가 잠금 없이 씁니다.
+struct MaskRegexEntry {
+    uint64_t hash = 0;
+    std::string pattern;
+    std::unique_ptr<CompiledRule> rule;  // 거절한 패턴이면 nullptr
+    std::string error;                  // 거절한 원인
+
+    bool Is(uint64_t h, const char* p, size_t len) const {
+        return hash == h && pattern.size() == len && memcmp(pattern.data(), p, len) == 0;
+    }
+};
+
+inline uint64_t MaskPatternHash(const char* p, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<uint8_t>(p[i]);
+        h *= 1099511628211ull;
+    }
+    return h ^ (h >> 32);
+}
+
+// 상수 패턴의 컴파일 상한: 규칙 파일의 규칙과 같고, std::regex로만 실행할 수 있는 패턴은 컴파일하지 않고 거절합니다.
+inline MaskCompileLimits MaskRegexConstantLimits() {
+    MaskCompileLimits limits;
+    limits.regex = false;
+    return limits;
+}
+
+// 상수가 아닌 패턴(캐시에서 밀려나면 다시 컴파일하는 패턴)의 더 싼 컴파일 상한
+inline MaskCompileLimits MaskRegexAdHocLimits() {
+    MaskCompileLimits limits = MaskRegexConstantLimits();
+    limits.max_dfa_states = kMaskRegexMaxDfaStates;
+    limits.required_byte = false;
+    return limits;
+}
+
+// 패턴을 컴파일합니다. 실패하거나 std::regex로만 실행할 수 있으면 rule이 nullptr이고 error에 원인이 있습니다.
+// 임시 패턴의 카운터와 지표는 모두 "mask_regex" 키 하나로 셉니다.
+inline std::shared_ptr<const MaskRegexEntry> CompileMaskRegex(
+    const char* p, size_t len, uint64_t hash, const MaskCompileLimits& limits = MaskRegexAdHocLimits()) {
+    std::shared_ptr<MaskRegexEntry> entry(new MaskRegexEntry());
+    entry->hash = hash;
+    entry->pattern.assign(p, len);
+    if (len > kMaskRegexMaxPattern) {
+        entry->error = "mask_regex: pattern is longer than " + std::to_string(kMaskRegexMaxPattern) + " bytes";
+        return entry;
+    }
+    MaskRuleSpec spec;
+    spec.key = "mask_regex";
+    spec.pattern = entry->pattern;
+    // 사전 규칙은 서버의 파일을 읽고 캐시 파일을 쓰므로 규칙 파일에서만 쓸 수 있습니다. 쿼리가 넘긴 패턴으로
+    // 임의의 파일을 읽거나 그 내용을 알아낼 수 없도록 컴파일하기 전에 거절합니다.
+    if (IsMaskDictRule(spec)) {
+        entry->error = std::string("mask_regex: ") + kMaskDictPrefix + " patterns are only allowed in the rules file";
+        return entry;
+    }
+    std::string error;
+    uint64_t start_ns = MaskNowNs();
+    std::unique_ptr<CompiledRule> rule = CompileMaskRule(spec, &error, limits);
+    if (rule == nullptr) {
+        entry->error = error;
+    } else {
+        MaskNodeMetrics::Instance().RecordCompile(spec.key, MaskNowNs() - start_ns, MaskRuleMemory(*rule));
+        entry->rule = std::move(rule);
+    }
+    return entry;
+}
+
+class MaskRegexCache {
+public:
+    static MaskRegexCache& Instance() {
+        static MaskRegexCache cache;
+        return cache;
+    }
+
+    // 패턴의 항목을 찾고, 없으면 컴파일해 넣습니다. 샤드가 차 있으면 가장 오래 쓰지 않은 항목을 내보냅니다.
+    std::shared_ptr<const MaskRegexEntry> Find(const char* p, size_t len, uint64_t hash) {
+        // 프런트 캐시는 해시의 하위 비트로 칸을 고르므로 샤드는 상위 비트로 고릅니다.
+        Shard& shard = shards_[(hash >> 56) % kMaskRegexShards];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (Slot* slot = shard.Lookup(hash, p, len)) return slot->entry;
+        }
+        std::shared_ptr<const MaskRegexEntry> entry = CompileMaskRegex(p, len, hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // 잠금 밖에서 컴파일하는 동안 다른 스레드가 같은 패턴을 넣었으면 그것을 씁니다.
+        if (Slot* slot = shard.Lookup(hash, p, len)) return slot->entry;
+        if (shard.slots.size() < kMaskRegexShardSlots) {
+            shard.slots.push_back(Slot{entry, ++shard.tick});
+            return entry;
+        }
+        Slot* oldest = &shard.slots[0];
+        for (Slot& slot : shard.slots) {
+            if (slot.last_used < oldest->last_used) oldest = &slot;
+        }
+        *oldest = Slot{entry, ++shard.tick};
+        return entry;
+    }
+
+private:
+    struct Slot {
+        std::shared_ptr<const MaskRegexEntry> entry;
+        uint64_t last_used;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+        uint64_t tick = 0;
+
+        Slot* Lookup(uint64_t hash, const char* p, size_t len) {
+            for (Slot& slot : slots) {
+                if (!slot.entry->Is(hash, p, len)) continue;
+                slot.last_used = ++tick;
+                return &slot;
+            }
+            return nullptr;
+        }
+    };
+
+    Shard shards_[kMaskRegexShards];
+};
+
+// 스레드별 프런트 캐시. 해시의 하위 비트로 칸 하나를 정하고, 칸에 다른 패턴이 있으면 덮어씁니다.
+struct MaskRegexFront {
+    std::shared_ptr<const MaskRegexEntry> slots[kMaskRegexFrontSlots];
+
+    // 패턴의 항목. 프런트 캐시에 있었으면 hit가 true입니다.
+    const MaskRegexEntry* Find(const char* p, size_t len, bool* hit) {
+        uint64_t hash = MaskPatternHash(p, len);
+        std::shared_ptr<const MaskRegexEntry>& slot = slots[hash % kMaskRegexFrontSlots];
+        *hit = slot != nullptr && slot->Is(hash, p, len);
+        if (!*hit) slot = MaskRegexCache::Instance().Find(p, len, hash);
+        return slot.get();
+    }
+};
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "MaskValidators.h"
+
+// regex_rules.txt 파일의 규칙 정의와 파서.
+// 한 줄에 하나의 규칙을 `키=정규표현식` 형식으로 적고, `#`으로 시작하는 줄은 주석입니다.
+// 키 뒤에 `[1,3]`처럼 캡처 그룹 번호를 붙이면 매치 전체가 아니라 해당 그룹만 마스킹합니다.
+//
+//   APN=\d{4}
+//   SSN[1]=\d{6}-(\d{7})
+//   TEL[1]=tel:(\d+)
+//
+// 키(와 그룹 목록) 뒤에 `{rrn}`, `{luhn}`, `{date6}`처럼 검증기를 붙이면 검증을 통과한 매치만 마스킹합니다.
+//
+//   SSN{date6,rrn}=\d{6}-\d{7}
+//   CARD{luhn}=\d{4}-\d{4}-\d{4}-\d{4}
+//
+// 맨 뒤에 `<바이트 수:키워드,...>`를 붙이면 매치 앞뒤로 그 바이트 수 안에 키워드가 있을 때만 마스킹합니다.
+//
+//   APN<16:전화,tel,phone>=\d{4}
+//
+// `@이름=규칙,...` 줄은 규칙 묶음(프로파일)을 정의합니다. mask_profile()이 한 번의 스캔으로 모든 규칙을 적용하며,
+// 서로 겹치는 매치는 앞에 적은 규칙의 것을 남깁니다.
+//
+//   @CALLCENTER=SSN,APN,EMAIL
+//
+// 패턴 자리에 `DICT:경로`를 적으면 해당 단어 목록 파일(한 줄에 한 단어)의 모든 단어를 마스킹하는 사전 규칙입니다.
+//
+//   NAME=DICT:/etc/impala/udf/names.txt
+
+// 한 규칙에서 지정할 수 있는 캡처 그룹의 최대 개수
+constexpr int kMaxMaskGroups = 16;
+
+struct MaskRuleSpec {
+    std::string key;
+    std::string pattern;
+    // 마스킹할 캡처 그룹 번호 (원본 패턴 기준). 비어 있으면 매치 전체를 마스킹합니다.
+    std::vector<int> groups;
+    // 매치가 모두 통과해야 하는 검증기 (MaskValidator 비트). 0이면 검증하지 않습니다.
+    uint32_t validators = 0;
+    // 매치 앞뒤 near_bytes 바이트 안에 있어야 하는 키워드. 비어 있으면 조건이 없습니다.
+    std::vector<std::string> near_keywords;
+    size_t near_bytes = 0;
+};
+
+// 이름 붙은 규칙 묶음. 규칙은 우선순위 순입니다.
+struct MaskProfileSpec {
+    std::string name;
+    std::vector<std::string> rules;
+};
+
+constexpr char kMaskDictPrefix[] = "DICT:";
+
+inline bool IsMaskDictRule(const MaskRuleSpec& spec) {
+    return spec.pattern.compare(0, sizeof(kMaskDictPrefix) - 1, kMaskDictPrefix) == 0;
+}
+
+// 사전 규칙의 단어 목록 파일 경로
+inline std::string MaskDictPath(const MaskRuleSpec& spec) {
+    return spec.pattern.substr(sizeof(kMaskDictPrefix) - 1);
+}
+
+// 규칙 파일이 없을 때 사용하는 기본 규칙. 그룹, 검증기, 근접 키워드가 없는 규칙이므로 키와 패턴만 채웁니다.
+inline std::vector<MaskRuleSpec> DefaultMaskRules() {
+    auto rule = [](const char* key, const char* pattern) {
+        MaskRuleSpec spec;
+        spec.key = key;
+        spec.pattern = pattern;
+        return spec;
+    };
+    return {
+        rule("APN", R"(\d{4})"),
+        rule("EMAIL", R"([a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,})"),
+        rule("SSN", R"(\d{6}-\d{7})"),
+    };
+}
+
+// 규칙 파일 경로: IMPALA_MASK_RULES_FILE 환경 변수가 있으면 그 값을 사용합니다.
+inline std::string MaskRulesPath() {
+    const char* env = std::getenv("IMPALA_MASK_RULES_FILE");
+    if (env != nullptr && env[0] != '\0') return env;
+    return "/etc/impala/udf/regex_rules.txt";
+}
+
+// `[1,3]` 형식의 그룹 목록을 파싱합니다.
+inline bool ParseMaskGroups(const std::string& text, std::vector<int>* groups, std::string* error) {
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos) {
+            *error = "invalid capture group '" + item + "'";
+            return false;
+        }
+        int group = std::atoi(item.c_str());
+        if (group <= 0) {
+            *error = "capture group must be >= 1";
+            return false;
+        }
+        groups->push_back(group);
+    }
+    if (groups->empty() || groups->size() > static_cast<size_t>(kMaxMaskGroups)) {
+        *error = "expected 1 to " + std::to_string(kMaxMaskGroups) + " capture groups";
+        return false;
+    }
+    return true;
+}
+
+// `16:전화,tel` 형식의 키워드 근접 조건을 파싱합니다.
+inline bool ParseMaskNear(const std::string& text, MaskRuleSpec* spec, std::string* error) {
+    size_t colon = text.find(':');
+    std::string bytes = text.substr(0, colon);
+    if (colon == std::string::npos || bytes.empty() || bytes.size() > 9 ||
+        bytes.find_first_not_of("0123456789") != std::string::npos) {
+        *error = "expected <BYTES:KEYWORD,...>";
+        return false;
+    }
+    spec->near_bytes = static_cast<size_t>(std::atol(bytes.c_str()));
+    std::stringstream ss(text.substr(colon + 1));
+    std::string keyword;
+    while (std::getline(ss, keyword, ',')) {
+        if (keyword.empty()) {
+            *error = "empty keyword";
+            return false;
+        }
+        spec->near_keywords.push_back(keyword);
+    }
+    if (spec->near_keywords.empty()) {
+        *error = "expected at least one keyword";
+        return false;
+    }
+    return true;
+}
+
+// `@이름=규칙,...` 줄을 파싱합니다. 같은 이름의 프로파일이 이미 있으면 바꿉니다.
+inline bool ParseMaskProfile(const std::string& line, size_t first, std::vector<MaskProfileSpec>* profiles,
+                             std::string* error) {
+    size_t eq = line.find('=', first);
+    if (eq == std::string::npos) {
+        *error = "expected @PROFILE=RULE,...";
+        return false;
+    }
+    MaskProfileSpec profile;
+    profile.name = line.substr(first + 1, eq - first - 1);
+    profile.name.erase(profile.name.find_last_not_of(" \t") + 1);
+    if (profile.name.empty()) {
+        *error = "empty profile name";
+        return false;
+    }
+    std::stringstream ss(line.substr(eq + 1));
+    std::string rule;
+    while (std::getline(ss, rule, ',')) {
+        rule.erase(0, rule.find_first_not_of(" \t"));
+        rule.erase(rule.find_last_not_of(" \t") + 1);
+        if (rule.empty()) {
+            *error = "empty rule in profile " + profile.name;
+            return false;
+        }
+        profile.rules.push_back(rule);
+    }
+    if (profile.rules.empty()) {
+        *error = "profile " + profile.name + " has no rules";
+        return false;
+    }
+    for (MaskProfileSpec& other : *profiles) {
+        if (other.name == profile.name) {
+            other = std::move(profile);
+            return true;
+        }
+    }
+    profiles->push_back(std::move(profile));
+    return true;
+}
+
+// 규칙 파일의 내용을 파싱합니다. 실패하면 error에 줄 번호와 원인을 담아 false를 반환합니다.
+// profiles가 nullptr이면 프로파일 줄은 건너뜁니다.
+inline bool ParseMaskRules(std::istream& in, std::vector<MaskRuleSpec>* rules, std::string* error,
+                           std::vector<MaskProfileSpec>* profiles = nullptr) {
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#') continue;
+        if (line[first] == '@') {
+            std::string profile_error;
+            if (profiles != nullptr && !ParseMaskProfile(line, first, profiles, &profile_error)) {
+                *error = "line " + std::to_string(line_no) + ": " + profile_error;
+                return false;
+            }
+            continue;
+        }
+
+        // 키워드에는 '='이 들어갈 수 있으므로 키워드 목록 뒤의 '='을 찾습니다.
+        size_t eq = line.find('=', first);
+        size_t angle = line.find('<', first);
+        if (angle != std::string::npos && angle < eq) {
+            size_t close = line.find('>', angle);
+            if (close != std::string::npos) eq = line.find('=', close);
+        }
+        if (eq == std::string::npos) {
+            *error = "line " + std::to_string(line_no) + ": expected KEY=PATTERN";
+            return false;
+        }
+
+        MaskRuleSpec spec;
+        std::string head = line.substr(first, eq - first);
+        head.erase(head.find_last_not_of(" \t") + 1);
+        size_t angle_open = head.find('<');
+        if (angle_open != std::string::npos && head.back() == '>') {
+            std::string near_error;
+            if (!ParseMaskNear(head.substr(angle_open + 1, head.size() - angle_open - 2), &spec, &near_error)) {
+                *error = "line " + std::to_string(line_no) + ": " + near_error;
+                return false;
+            }
+            head.erase(angle_open);
+        }
+        size_t brace = head.rfind('{');
+        if (brace != std::string::npos && head.back() == '}') {
+            std::string validator_error;
+            if (!ParseMaskValidators(head.substr(brace + 1, head.size() - brace - 2), &spec.validators,
+                                     &validator_error)) {
+                *error = "line " + std::to_string(line_no) + ": " + validator_error;
+                return false;
+            }
+            head.erase(brace);
+        }
+        if (head.find_first_of("{}<>") != std::string::npos) {
+            *error = "line " + std::to_string(line_no) + ": expected KEY[GROUPS]{VALIDATORS}<BYTES:KEYWORDS>";
+            return false;
+        }
+        size_t bracket = head.find('[');
+        if (bracket != std::string::npos) {
+            if (head.back() != ']') {
+                *error = "line " + std::to_string(line_no) + ": unterminated group list";
+                return false;
+            }
+            std::string group_error;
+            if (!ParseMaskGroups(head.substr(bracket + 1, head.size() - bracket - 2),
+                                 &spec.groups, &group_error)) {
+                *error = "line " + std::to_string(line_no) + ": " + group_error;
+                return false;
+            }
+            head.erase(bracket);
+        }
+        if (head.empty()) {
+            *error = "line " + std::to_string(line_no) + ": empty rule key";
+            return false;
+        }
+        spec.key = head;
+        spec.pattern = line.substr(eq + 1);
+        rules->push_back(std::move(spec));
+    }
+    if (profiles != nullptr) {
+        for (const MaskProfileSpec& profile : *profiles) {
+            for (const std::string& rule : profile.rules) {
+                bool known = std::any_of(rules->begin(), rules->end(),
+                                         [&](const MaskRuleSpec& spec) { return spec.key == rule; });
+                if (!known) {
+                    *error = "profile " + profile.name + ": unknown rule '" + rule + "'";
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// 규칙 파일을 읽습니다. 파일이 없으면 기본 규칙을 사용합니다.
+inline bool LoadMaskRules(const std::string& path, std::vector<MaskRuleSpec>* rules, std::string* error,
+                          std::vector<MaskProfileSpec>* profiles = nullptr) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        *rules = DefaultMaskRules();
+        return true;
+    }
+    if (!ParseMaskRules(in, rules, error, profiles)) {
+        *error = path + ": " + *error;
+        return false;
+    }
+    return true;
+}
+
+// 같은 키가 여러 번 나오면 마지막 정의만 남깁니다(위치는 처음 나온 자리). 규칙 id는 이 목록의 인덱스입니다.
+inline void DedupMaskRules(std::vector<MaskRuleSpec>* rules) {
+    std::vector<MaskRuleSpec> unique;
+    for (MaskRuleSpec& spec : *rules) {
+        auto it = std::find_if(unique.begin(), unique.end(),
+                               [&](const MaskRuleSpec& other) { return other.key == spec.key; });
+        if (it != unique.end()) {
+            *it = std::move(spec);
+        } else {
+            unique.push_back(std::move(spec));
+        }
+    }
+    rules->swap(unique);
+}
+
+// 규칙 키 → 규칙 id 완전 해시. 적재할 때 키들이 서로 충돌하지 않는 시드를 찾아 두고, 조회할 때는
+// 입력 바이트를 그 자리에서 해시해 후보 하나와 비교합니다. 조회에는 힙 할당도 잠금도 없습니다.
+class MaskRuleIndex {
+public:
+    // 키는 서로 달라야 합니다(DedupMaskRules).
+    void Build(const std::vector<MaskRuleSpec>& rules) {
+        std::vector<std::string> keys;
+        for (const MaskRuleSpec& spec : rules) keys.push_back(spec.key);
+        Build(std::move(keys));
+    }
+
+    void Build(std::vector<std::string> keys) {
+        keys_ = std::move(keys);
+        slots_.clear();
+        if (keys_.empty()) return;
+        size_t size = 1;
+        while (size < keys_.size() * 2) size <<= 1;
+        for (uint64_t seed = 1;; ++seed) {
+            // 시드를 충분히 바꿔도 충돌하면 표를 키웁니다.
+            if (seed % 64 == 0) size <<= 1;
+            if (TrySeed(seed, size)) return;
+        }
+    }
+
+    // 키의 규칙 id. 없으면 -1
+    int Find(const char* key, size_t len) const {
+        if (slots_.empty()) return -1;
+        int id = slots_[Hash(key, len, seed_) & (slots_.size() - 1)];
+        if (id < 0 || keys_[id].size() != len || memcmp(keys_[id].data(), key, len) != 0) return -1;
+        return id;
+    }
+
+private:
+    static uint64_t Hash(const char* p, size_t len, uint64_t seed) {
+        uint64_t h = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+        for (size_t i = 0; i < len; ++i) {
+            h ^= static_cast<uint8_t>(p[i]);
+            h *= 1099511628211ull;
+        }
+        return h ^ (h >> 32);
+    }
+
+    bool TrySeed(uint64_t seed, size_t size) {
+        slots_.assign(size, -1);
+        for (size_t id = 0; id < keys_.size(); ++id) {
+            int& slot = slots_[Hash(keys_[id].data(), keys_[id].size(), seed) & (size - 1)];
+            if (slot >= 0) return false;
+            slot = static_cast<int>(id);
+        }
+        seed_ = seed;
+        return true;
+    }
+
+    std::vector<std::string> keys_;
+    std::vector<int> slots_;
+    uint64_t seed_ = 0;
+};
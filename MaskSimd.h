@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// 바이트 집합 검색 커널. DFA 스캔에서 매치를 시작할 수 없는 바이트를 건너뛰는 데 씁니다.
+// 아래의 리터럴 집합 검색 커널(Teddy)은 같은 니블 표를 리터럴의 앞 바이트마다 두어 행 사전 필터로 씁니다.
+//
+// 바이트 b가 집합에 속하는지를 lo[b & 15] & hi[b >> 4] != 0으로 판정합니다(shufti).
+// 상위 니블마다 허용되는 하위 니블 집합이 서로 다른 것이 8개 이하이면 정확히 표현되고,
+// 그보다 많으면 스칼라 표(member)를 사용합니다.
+//
+// SSSE3 / AVX2 / AVX-512BW 변형을 모두 이 헤더에 target 속성으로 컴파일해 두고, 라이브러리가
+// 처음 쓰일 때 cpuid로 한 번 골라 함수 포인터로 호출합니다. 모든 변형의 결과는 스칼라 구현과 같습니다.
+// IMPALA_MASK_ISA=scalar|ssse3|avx2|avx512로 낮은 변형을 강제할 수 있습니다(CPU가 지원하는 범위 안에서).
+struct ByteSetFinder {
+    // 16바이트 표를 4번 반복해 두어 SSE/AVX2/AVX-512가 각자의 폭으로 바로 읽습니다.
+    alignas(64) uint8_t lo[64] = {};
+    alignas(64) uint8_t hi[64] = {};
+    bool exact = false;
+    const bool* member = nullptr;  // 256개 항목의 집합 표
+
+    void Build(const bool* set) {
+        member = set;
+        uint16_t lows[16] = {};
+        for (int b = 0; b < 256; ++b) {
+            if (set[b]) lows[b >> 4] |= static_cast<uint16_t>(1u << (b & 15));
+        }
+        uint16_t buckets[8];
+        int num_buckets = 0;
+        memset(lo, 0, sizeof(lo));
+        memset(hi, 0, sizeof(hi));
+        for (int h = 0; h < 16; ++h) {
+            if (lows[h] == 0) continue;
+            int k = 0;
+            while (k < num_buckets && buckets[k] != lows[h]) ++k;
+            if (k == num_buckets) {
+                if (num_buckets == 8) {
+                    exact = false;
+                    return;
+                }
+                buckets[num_buckets++] = lows[h];
+                for (int l = 0; l < 16; ++l) {
+                    if (lows[h] & (1u << l)) lo[l] |= static_cast<uint8_t>(1u << k);
+                }
+            }
+            hi[h] = static_cast<uint8_t>(1u << k);
+        }
+        for (int i = 16; i < 64; ++i) {
+            lo[i] = lo[i & 15];
+            hi[i] = hi[i & 15];
+        }
+        exact = true;
+    }
+};
+
+inline const uint8_t* FindInSetScalar(const ByteSetFinder& finder, const uint8_t* p, const uint8_t* e) {
+    while (p < e && !finder.member[*p]) ++p;
+    return p;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("ssse3"))) inline const uint8_t* FindInSetSsse3(const ByteSetFinder& finder,
+                                                                       const uint8_t* p, const uint8_t* e) {
+    if (!finder.exact) return FindInSetScalar(finder, p, e);
+    const __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(finder.lo));
+    const __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(finder.hi));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    for (; e - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(x, nibble));
+        __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(l, h), zero))) & 0xffff;
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return FindInSetScalar(finder, p, e);
+}
+
+__attribute__((target("avx2"))) inline const uint8_t* FindInSetAvx2(const ByteSetFinder& finder, const uint8_t* p,
+                                                                     const uint8_t* e) {
+    if (!finder.exact) return FindInSetScalar(finder, p, e);
+    const __m256i lo = _mm256_load_si256(reinterpret_cast<const __m256i*>(finder.lo));
+    const __m256i hi = _mm256_load_si256(reinterpret_cast<const __m256i*>(finder.hi));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; e - p >= 32; p += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, nibble));
+        __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero)));
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return FindInSetSsse3(finder, p, e);
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline const uint8_t* FindInSetAvx512(const ByteSetFinder& finder,
+                                                                                   const uint8_t* p,
+                                                                                   const uint8_t* e) {
+    if (!finder.exact) return FindInSetScalar(finder, p, e);
+    const __m512i lo = _mm512_load_si512(finder.lo);
+    const __m512i hi = _mm512_load_si512(finder.hi);
+    const __m512i nibble = _mm512_set1_epi8(0x0f);
+    for (; e - p >= 64; p += 64) {
+        __m512i x = _mm512_loadu_si512(p);
+        __m512i l = _mm512_shuffle_epi8(lo, _mm512_and_si512(x, nibble));
+        __m512i h = _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi16(x, 4), nibble));
+        uint64_t mask = _mm512_test_epi8_mask(l, h);
+        if (mask != 0) return p + __builtin_ctzll(mask);
+    }
+    return FindInSetAvx2(finder, p, e);
+}
+#endif
+
+// 리터럴 집합 검색 표 (Teddy).
+//
+// 리터럴을 8개의 버킷에 나눠 담고, 앞 width(1~3) 바이트의 j번째 바이트마다 shufti와 같은 lo/hi 니블 표를 둡니다.
+// 표의 비트 k는 "버킷 k의 어떤 리터럴의 j번째 바이트일 수 있음"이며, 위치 p에서 width개 표의 결과를 AND한 비트가
+// 남으면 그 버킷의 리터럴만 memcmp로 확인합니다. 니블 단위 표라 거짓 양성이 있을 수 있지만 확인에서 걸러집니다.
+// 앞 바이트가 같은 리터럴은 같은 버킷에 두어 후보 하나에서 확인하는 리터럴 수를 줄입니다.
+constexpr size_t kMaskMaxLiterals = 64;
+constexpr int kMaskLiteralBuckets = 8;
+
+struct LiteralSetFinder {
+    alignas(64) uint8_t lo[3][32] = {};  // 16바이트 표를 두 번 반복해 SSE/AVX2가 각자의 폭으로 바로 읽습니다.
+    alignas(64) uint8_t hi[3][32] = {};
+    int width = 0;
+    size_t min_length = 0;
+    std::vector<std::string> buckets[kMaskLiteralBuckets];
+
+    // 비어 있지 않은 리터럴 kMaskMaxLiterals개 이하로 표를 만듭니다. 그보다 많거나 빈 리터럴이 있으면 false입니다.
+    bool Build(std::vector<std::string> literals) {
+        std::sort(literals.begin(), literals.end());
+        literals.erase(std::unique(literals.begin(), literals.end()), literals.end());
+        if (literals.empty() || literals.size() > kMaskMaxLiterals) return false;
+        min_length = literals[0].size();
+        for (const std::string& literal : literals) min_length = std::min(min_length, literal.size());
+        if (min_length == 0) return false;
+        width = static_cast<int>(std::min<size_t>(3, min_length));
+        // 정렬된 목록에서 앞 width 바이트가 같은 리터럴끼리 묶어 버킷을 차례로 돌며 담습니다.
+        int bucket = -1;
+        for (size_t i = 0; i < literals.size(); ++i) {
+            if (i == 0 || literals[i].compare(0, width, literals[i - 1], 0, width) != 0) {
+                bucket = (bucket + 1) % kMaskLiteralBuckets;
+            }
+            const std::string& literal = literals[i];
+            for (int j = 0; j < width; ++j) {
+                uint8_t c = static_cast<uint8_t>(literal[j]);
+                lo[j][c & 15] |= static_cast<uint8_t>(1u << bucket);
+                hi[j][c >> 4] |= static_cast<uint8_t>(1u << bucket);
+            }
+            buckets[bucket].push_back(literal);
+        }
+        for (int j = 0; j < width; ++j) {
+            for (int i = 16; i < 32; ++i) {
+                lo[j][i] = lo[j][i & 15];
+                hi[j][i] = hi[j][i & 15];
+            }
+        }
+        return true;
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const auto& bucket : buckets) n += bucket.size();
+        return n;
+    }
+
+    // 위치 p에서 bits의 버킷에 든 리터럴 하나가 [p, e) 안에서 시작하는지 확인합니다.
+    bool Verify(const uint8_t* p, const uint8_t* e, unsigned bits) const {
+        for (; bits != 0; bits &= bits - 1) {
+            for (const std::string& literal : buckets[__builtin_ctz(bits)]) {
+                if (static_cast<size_t>(e - p) >= literal.size() && memcmp(p, literal.data(), literal.size()) == 0) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+// [p, e)에서 리터럴이 처음 시작하는 위치. 없으면 e입니다.
+inline const uint8_t* FindLiteralsScalar(const LiteralSetFinder& finder, const uint8_t* p, const uint8_t* e) {
+    for (; p < e; ++p) {
+        unsigned bits = 0xff;
+        for (int j = 0; j < finder.width && bits != 0; ++j) {
+            if (p + j >= e) return e;
+            bits &= finder.lo[j][p[j] & 15] & finder.hi[j][p[j] >> 4];
+        }
+        if (bits != 0 && finder.Verify(p, e, bits)) return p;
+    }
+    return e;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("ssse3"))) inline const uint8_t* FindLiteralsSsse3(const LiteralSetFinder& finder,
+                                                                          const uint8_t* p, const uint8_t* e) {
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    alignas(16) uint8_t bits[16];
+    // 블록의 마지막 위치에서도 width 바이트를 읽을 수 있는 동안만 SIMD로 진행합니다.
+    for (; e - p >= 16 + finder.width - 1; p += 16) {
+        __m128i r = _mm_set1_epi8(-1);
+        for (int j = 0; j < finder.width; ++j) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j));
+            __m128i l = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(finder.lo[j])),
+                                         _mm_and_si128(x, nibble));
+            __m128i h = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(finder.hi[j])),
+                                         _mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+            r = _mm_and_si128(r, _mm_and_si128(l, h));
+        }
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(r, zero))) & 0xffff;
+        if (mask == 0) continue;
+        _mm_store_si128(reinterpret_cast<__m128i*>(bits), r);
+        for (; mask != 0; mask &= mask - 1) {
+            int i = __builtin_ctz(mask);
+            if (finder.Verify(p + i, e, bits[i])) return p + i;
+        }
+    }
+    return FindLiteralsScalar(finder, p, e);
+}
+
+__attribute__((target("avx2"))) inline const uint8_t* FindLiteralsAvx2(const LiteralSetFinder& finder,
+                                                                        const uint8_t* p, const uint8_t* e) {
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    alignas(32) uint8_t bits[32];
+    for (; e - p >= 32 + finder.width - 1; p += 32) {
+        __m256i r = _mm256_set1_epi8(-1);
+        for (int j = 0; j < finder.width; ++j) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j));
+            __m256i l = _mm256_shuffle_epi8(_mm256_load_si256(reinterpret_cast<const __m256i*>(finder.lo[j])),
+                                            _mm256_and_si256(x, nibble));
+            __m256i h = _mm256_shuffle_epi8(_mm256_load_si256(reinterpret_cast<const __m256i*>(finder.hi[j])),
+                                            _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+            r = _mm256_and_si256(r, _mm256_and_si256(l, h));
+        }
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(r, zero)));
+        if (mask == 0) continue;
+        _mm256_store_si256(reinterpret_cast<__m256i*>(bits), r);
+        for (; mask != 0; mask &= mask - 1) {
+            int i = __builtin_ctz(mask);
+            if (finder.Verify(p + i, e, bits[i])) return p + i;
+        }
+    }
+    return FindLiteralsSsse3(finder, p, e);
+}
+#endif
+
+typedef const uint8_t* (*FindInSetFn)(const ByteSetFinder& finder, const uint8_t* p, const uint8_t* e);
+typedef const uint8_t* (*FindLiteralsFn)(const LiteralSetFinder& finder, const uint8_t* p, const uint8_t* e);
+
+// 리터럴 집합 검색은 AVX-512 변형을 따로 두지 않고 avx512에서도 AVX2 커널을 씁니다. 후보 확인이 비용의 대부분인
+// 입력에서는 폭을 넓혀도 이득이 적기 때문입니다.
+struct MaskKernels {
+    const char* isa;
+    FindInSetFn find_in_set;
+    FindLiteralsFn find_literals;
+};
+
+// IMPALA_MASK_ISA로 강제할 수 있는 변형 이름인지
+inline bool IsMaskIsaName(const char* name) {
+    static const char* const kNames[] = {"scalar", "ssse3", "avx2", "avx512"};
+    for (const char* isa : kNames) {
+        if (strcmp(name, isa) == 0) return true;
+    }
+    return false;
+}
+
+// 알 수 없는 IMPALA_MASK_ISA 값은 잘못 쓴 것일 수 있으므로 조용히 scalar로 떨어지지 않고, stderr(impalad 로그)에
+// 남긴 뒤 강제하지 않은 것처럼 CPU에 맞는 변형을 고릅니다.
+inline MaskKernels SelectMaskKernels() {
+    const char* forced = std::getenv("IMPALA_MASK_ISA");
+    if (forced != nullptr && forced[0] == '\0') forced = nullptr;
+    if (forced != nullptr && !IsMaskIsaName(forced)) {
+        fprintf(stderr, "impala mask: ignoring unknown IMPALA_MASK_ISA=%s (expected scalar, ssse3, avx2 or avx512)\n",
+                forced);
+        forced = nullptr;
+    }
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    struct Variant {
+        MaskKernels kernels;
+        bool supported;
+    };
+    const Variant variants[] = {
+        {{"avx512", FindInSetAvx512, FindLiteralsAvx2}, __builtin_cpu_supports("avx512bw") != 0},
+        {{"avx2", FindInSetAvx2, FindLiteralsAvx2}, __builtin_cpu_supports("avx2") != 0},
+        {{"ssse3", FindInSetSsse3, FindLiteralsSsse3}, __builtin_cpu_supports("ssse3") != 0},
+    };
+    // 강제한 변형이 있으면 그보다 높은 변형은 건너뜁니다.
+    bool reached = forced == nullptr;
+    for (const Variant& variant : variants) {
+        if (!reached && strcmp(forced, variant.kernels.isa) != 0) continue;
+        reached = true;
+        if (variant.supported) return variant.kernels;
+    }
+#endif
+    return {"scalar", FindInSetScalar, FindLiteralsScalar};
+}
+
+// 라이브러리에서 처음 쓰일 때 한 번 고른 커널 (스레드 안전한 정적 초기화)
+inline const MaskKernels& GetMaskKernels() {
+    static const MaskKernels kernels = SelectMaskKernels();
+    return kernels;
+}
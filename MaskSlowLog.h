@@ -0,0 +1,88 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "MaskCrypto.h"
+#include "MaskStats.h"
+
+// 느린 행 기록. IMPALA_MASK_SLOW_US보다 오래 걸린 행의 규칙 키, 입력 길이, 매치 수, 처리 시간과
+// 입력의 keyed hash를 IMPALA_MASK_SLOW_LOG 파일에 남깁니다. 원문은 남기지 않습니다.
+//
+// 파일은 고정 길이(kSlowRecordSize) 레코드 IMPALA_MASK_SLOW_SLOTS개(기본 1024)로 된 링 버퍼입니다.
+// 전역 순번으로 슬롯을 정해 pwrite 한 번으로 쓰므로 잠금이 없고, 파일 크기도 늘어나지 않습니다.
+// 해시 키는 IMPALA_MASK_SLOW_SECRET이 가리키는 키 파일(tokenize와 같은 형식)에서 읽고, 없으면
+// 프로세스마다 임의로 정합니다. 같은 키로 후보 데이터를 해시하면 오프라인에서 행을 찾을 수 있습니다.
+constexpr size_t kSlowRecordSize = 160;
+
+// 스레드마다 1초에 기록하는 행 수의 상한
+constexpr uint64_t kSlowRowsPerSecond = 10;
+
+inline uint64_t MaskSlowThresholdNs() {
+    const char* env = std::getenv("IMPALA_MASK_SLOW_US");
+    if (env == nullptr) return 0;
+    long long us = std::atoll(env);
+    return us > 0 ? static_cast<uint64_t>(us) * 1000 : 0;
+}
+
+class MaskSlowLog {
+public:
+    static MaskSlowLog& Instance() {
+        static MaskSlowLog log;
+        return log;
+    }
+
+    void Record(const std::string& rule_key, const uint8_t* input, size_t len, size_t matches, uint64_t elapsed_ns) {
+        if (fd_ < 0) return;
+        uint64_t seq = next_seq_.fetch_add(1, std::memory_order_relaxed);
+        char record[kSlowRecordSize];
+        int n = snprintf(record, sizeof(record), "seq=%llu time=%lld rule=%.40s len=%llu matches=%llu elapsed_ns=%llu hash=%016llx",
+                         static_cast<unsigned long long>(seq), static_cast<long long>(time(nullptr)), rule_key.c_str(),
+                         static_cast<unsigned long long>(len), static_cast<unsigned long long>(matches),
+                         static_cast<unsigned long long>(elapsed_ns),
+                         static_cast<unsigned long long>(SipHash24(hash_key_, input, len)));
+        size_t used = std::min(static_cast<size_t>(n), kSlowRecordSize - 1);
+        memset(record + used, ' ', kSlowRecordSize - 1 - used);
+        record[kSlowRecordSize - 1] = '\n';
+        off_t offset = static_cast<off_t>((seq % slots_) * kSlowRecordSize);
+        if (pwrite(fd_, record, kSlowRecordSize, offset) < 0) return;  // 기록 실패는 쿼리에 영향을 주지 않습니다.
+    }
+
+private:
+    MaskSlowLog() {
+        const char* path = std::getenv("IMPALA_MASK_SLOW_LOG");
+        if (path == nullptr || *path == '\0') return;
+        const char* slots = std::getenv("IMPALA_MASK_SLOW_SLOTS");
+        if (slots != nullptr && std::atoll(slots) > 0) slots_ = static_cast<uint64_t>(std::atoll(slots));
+
+        MaskSecret secret;
+        std::string error;
+        const char* secret_ref = std::getenv("IMPALA_MASK_SLOW_SECRET");
+        if (secret_ref == nullptr || !LoadMaskSecret(secret_ref, &secret, &error)) {
+            std::random_device random;
+            for (uint8_t& b : secret.bytes) b = static_cast<uint8_t>(random());
+        }
+        hash_key_ = MakeSipHashKey(secret);
+        fd_ = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    }
+
+    ~MaskSlowLog() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    int fd_ = -1;
+    uint64_t slots_ = 1024;
+    SipHashKey hash_key_{0, 0};
+    std::atomic<uint64_t> next_seq_{0};
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 규칙별 실행 카운터. 스레드마다 따로 세고(THREAD_LOCAL 상태), 스레드가 끝날 때 프래그먼트 합계에 더합니다.
+struct MaskRuleCounters {
+    uint64_t rows = 0;             // 평가한 행
+    uint64_t rows_skipped = 0;     // 사전 필터로 스캔을 건너뛴 행
+    uint64_t rows_matched = 0;     // 매치가 하나 이상 있던 행
+    uint64_t matches = 0;          // 마스킹한 구간 수
+    uint64_t bytes_scanned = 0;    // 입력 바이트
+    uint64_t bytes_allocated = 0;  // 결과로 할당한 바이트
+    uint64_t cache_hits = 0;       // 컴파일된 규칙 캐시 적중
+    uint64_t cache_misses = 0;     // 규칙 컴파일
+    uint64_t adapt_windows = 0;          // 적응 제어가 판단한 창 (MaskAdaptive.h)
+    uint64_t prefilter_off_windows = 0;  // 그중 사전 필터를 끄고 실행한 창
+    uint64_t memo_off_windows = 0;       // 실패 경로 기록을 끄고 실행한 창
+    uint64_t simd_off_windows = 0;       // 첫 바이트 검색에 스칼라 루프를 쓴 창
+
+    void Add(const MaskRuleCounters& other) {
+        rows += other.rows;
+        rows_skipped += other.rows_skipped;
+        rows_matched += other.rows_matched;
+        matches += other.matches;
+        bytes_scanned += other.bytes_scanned;
+        bytes_allocated += other.bytes_allocated;
+        cache_hits += other.cache_hits;
+        cache_misses += other.cache_misses;
+        adapt_windows += other.adapt_windows;
+        prefilter_off_windows += other.prefilter_off_windows;
+        memo_off_windows += other.memo_off_windows;
+        simd_off_windows += other.simd_off_windows;
+    }
+};
+
+// 규칙 id로 인덱싱하는 카운터 목록. 새 규칙이 처음 쓰일 때만 커집니다.
+struct MaskCounterTable {
+    std::vector<MaskRuleCounters> by_rule;
+
+    MaskRuleCounters& For(int rule_id) {
+        if (static_cast<size_t>(rule_id) >= by_rule.size()) by_rule.resize(rule_id + 1);
+        return by_rule[rule_id];
+    }
+
+    void Add(const MaskCounterTable& other) {
+        for (size_t i = 0; i < other.by_rule.size(); ++i) For(static_cast<int>(i)).Add(other.by_rule[i]);
+    }
+};
+
+inline std::string FormatMaskCounters(const std::string& rule_key, const MaskRuleCounters& c) {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "mask stats rule=%s rows=%llu skipped=%llu matched=%llu matches=%llu bytes_scanned=%llu "
+             "bytes_allocated=%llu cache_hits=%llu cache_misses=%llu windows=%llu prefilter_off=%llu memo_off=%llu "
+             "simd_off=%llu",
+             rule_key.c_str(), static_cast<unsigned long long>(c.rows),
+             static_cast<unsigned long long>(c.rows_skipped), static_cast<unsigned long long>(c.rows_matched),
+             static_cast<unsigned long long>(c.matches), static_cast<unsigned long long>(c.bytes_scanned),
+             static_cast<unsigned long long>(c.bytes_allocated), static_cast<unsigned long long>(c.cache_hits),
+             static_cast<unsigned long long>(c.cache_misses), static_cast<unsigned long long>(c.adapt_windows),
+             static_cast<unsigned long long>(c.prefilter_off_windows),
+             static_cast<unsigned long long>(c.memo_off_windows), static_cast<unsigned long long>(c.simd_off_windows));
+    return buf;
+}
+
+// 카운터 출력 대상: IMPALA_MASK_STATS 환경 변수가 비어 있으면 출력하지 않고,
+// "warning"이면 쿼리 경고로, 그 밖의 값이면 해당 경로의 파일 끝에 한 줄씩 덧붙입니다.
+inline std::string MaskStatsTarget() {
+    const char* env = std::getenv("IMPALA_MASK_STATS");
+    return env != nullptr ? env : "";
+}
+
+inline bool AppendMaskStatsLines(const std::string& path, const std::vector<std::string>& lines) {
+    FILE* f = fopen(path.c_str(), "a");
+    if (f == nullptr) return false;
+    for (const std::string& line : lines) fprintf(f, "%s\n", line.c_str());
+    return fclose(f) == 0;
+}
+
+// 행 단위 지연 시간 샘플링. IMPALA_MASK_SAMPLE=N이면 스레드마다 N번째 행마다 한 번 시간을 잽니다.
+// 0이거나 설정하지 않으면 샘플링하지 않으며, 이때 행마다 드는 비용은 분기 하나입니다.
+inline uint64_t MaskSampleEvery() {
+    const char* env = std::getenv("IMPALA_MASK_SAMPLE");
+    if (env == nullptr) return 0;
+    long long every = std::atoll(env);
+    return every > 0 ? static_cast<uint64_t>(every) : 0;
+}
+
+inline uint64_t MaskNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// 로그-선형(HDR 방식) 버킷: 2의 거듭제곱 구간마다 2^kLatencySubBits개의 하위 버킷으로 나눠
+// 상대 오차를 25% 이하로 유지합니다. 입력 길이도 4배 간격의 구간으로 나눠 따로 셉니다.
+constexpr int kLatencySubBits = 2;
+constexpr int kLatencyBuckets = 64 << kLatencySubBits;
+constexpr int kLengthClasses = 8;   // <16, <64, <256, <1K, <4K, <16K, <64K, 그 이상
+constexpr int kSlowestSamples = 8;
+
+inline int LatencyBucket(uint64_t ns) {
+    if (ns < (1u << kLatencySubBits)) return static_cast<int>(ns);
+    int exponent = 63 - __builtin_clzll(ns);
+    int sub = static_cast<int>(ns >> (exponent - kLatencySubBits)) & ((1 << kLatencySubBits) - 1);
+    return ((exponent - kLatencySubBits + 1) << kLatencySubBits) + sub;
+}
+
+// 버킷에 들어가는 가장 작은 값
+inline uint64_t LatencyBucketLow(int bucket) {
+    if (bucket < (1 << kLatencySubBits)) return static_cast<uint64_t>(bucket);
+    int exponent = (bucket >> kLatencySubBits) + kLatencySubBits - 1;
+    uint64_t sub = static_cast<uint64_t>(bucket & ((1 << kLatencySubBits) - 1));
+    return ((1ull << kLatencySubBits) + sub) << (exponent - kLatencySubBits);
+}
+
+inline int LengthClass(size_t len) {
+    if (len < 16) return 0;
+    int bits = 63 - __builtin_clzll(static_cast<unsigned long long>(len));
+    return std::min(kLengthClasses - 1, (bits - 4) / 2 + 1);
+}
+
+inline const char* LengthClassName(int length_class) {
+    static const char* const kNames[kLengthClasses] = {"<16", "<64", "<256", "<1K", "<4K", "<16K", "<64K", ">=64K"};
+    return kNames[length_class];
+}
+
+struct MaskSlowSample {
+    uint64_t ns = 0;
+    uint64_t len = 0;
+};
+
+// 규칙 하나의 지연 시간 히스토그램과 가장 느린 샘플들 (ns 내림차순)
+struct MaskLatencyHistogram {
+    uint64_t counts[kLengthClasses][kLatencyBuckets] = {};
+    uint64_t samples[kLengthClasses] = {};
+    MaskSlowSample slowest[kSlowestSamples];
+
+    void Record(uint64_t ns, size_t len) {
+        int length_class = LengthClass(len);
+        ++counts[length_class][LatencyBucket(ns)];
+        ++samples[length_class];
+        MaskSlowSample sample;
+        sample.ns = ns;
+        sample.len = len;
+        InsertSlow(sample);
+    }
+
+    void Add(const MaskLatencyHistogram& other) {
+        for (int c = 0; c < kLengthClasses; ++c) {
+            samples[c] += other.samples[c];
+            for (int b = 0; b < kLatencyBuckets; ++b) counts[c][b] += other.counts[c][b];
+        }
+        for (const MaskSlowSample& sample : other.slowest) InsertSlow(sample);
+    }
+
+    // 분위수 q(0~1)에 해당하는 버킷의 하한 (ns)
+    uint64_t Percentile(int length_class, double q) const {
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(samples[length_class] - 1));
+        uint64_t seen = 0;
+        for (int b = 0; b < kLatencyBuckets; ++b) {
+            seen += counts[length_class][b];
+            if (seen > rank) return LatencyBucketLow(b);
+        }
+        return 0;
+    }
+
+private:
+    void InsertSlow(const MaskSlowSample& sample) {
+        if (sample.ns <= slowest[kSlowestSamples - 1].ns) return;
+        int i = kSlowestSamples - 1;
+        for (; i > 0 && slowest[i - 1].ns < sample.ns; --i) slowest[i] = slowest[i - 1];
+        slowest[i] = sample;
+    }
+};
+
+// 규칙 id로 인덱싱하는 히스토그램 목록. 히스토그램은 크기가 커서(약 16KB) 샘플이 처음 들어올 때 만듭니다.
+struct MaskLatencyTable {
+    std::vector<std::unique_ptr<MaskLatencyHistogram>> by_rule;
+
+    MaskLatencyHistogram& For(int rule_id) {
+        if (static_cast<size_t>(rule_id) >= by_rule.size()) by_rule.resize(rule_id + 1);
+        if (by_rule[rule_id] == nullptr) by_rule[rule_id].reset(new MaskLatencyHistogram());
+        return *by_rule[rule_id];
+    }
+
+    void Add(const MaskLatencyTable& other) {
+        for (size_t i = 0; i < other.by_rule.size(); ++i) {
+            if (other.by_rule[i] != nullptr) For(static_cast<int>(i)).Add(*other.by_rule[i]);
+        }
+    }
+};
+
+// 길이 구간마다 한 줄, 가장 느린 샘플들로 한 줄을 만듭니다. 입력 내용은 남기지 않고 길이만 남깁니다.
+inline void FormatMaskLatency(const std::string& rule_key, const MaskLatencyHistogram& h,
+                              std::vector<std::string>* lines) {
+    char buf[512];
+    for (int c = 0; c < kLengthClasses; ++c) {
+        if (h.samples[c] == 0) continue;
+        uint64_t max_ns = 0;
+        for (int b = kLatencyBuckets - 1; b >= 0; --b) {
+            if (h.counts[c][b] != 0) {
+                max_ns = LatencyBucketLow(b);
+                break;
+            }
+        }
+        snprintf(buf, sizeof(buf), "mask latency rule=%s len%s samples=%llu p50=%lluns p90=%lluns p99=%lluns max=%lluns",
+                 rule_key.c_str(), LengthClassName(c), static_cast<unsigned long long>(h.samples[c]),
+                 static_cast<unsigned long long>(h.Percentile(c, 0.50)),
+                 static_cast<unsigned long long>(h.Percentile(c, 0.90)),
+                 static_cast<unsigned long long>(h.Percentile(c, 0.99)), static_cast<unsigned long long>(max_ns));
+        lines->push_back(buf);
+    }
+    std::string slowest = "mask slowest rule=" + rule_key;
+    for (const MaskSlowSample& sample : h.slowest) {
+        if (sample.ns == 0) break;
+        snprintf(buf, sizeof(buf), " %lluns/len=%llu", static_cast<unsigned long long>(sample.ns),
+                 static_cast<unsigned long long>(sample.len));
+        slowest += buf;
+    }
+    lines->push_back(slowest);
+}
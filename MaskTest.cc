@@ -0,0 +1,1007 @@
+// 마스킹 코어의 회귀 테스트 (Impala 헤더 불필요).
+//
+//   g++ -O2 -std=c++17 -pthread -o mask_test MaskTest.cc && ./mask_test
+//
+// 실패한 검사마다 stderr에 한 줄을 남기고, 하나라도 실패하면 종료 코드가 1입니다.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "MaskEngine.h"
+#include "MaskProfile.h"
+#include "MaskRegexCache.h"
+
+// mask_cli의 main을 MaskCliMain으로 바꿔 함께 링크합니다.
+#define main MaskCliMain
+#include "MaskCli.cc"
+#undef main
+
+static int g_checks = 0;
+static int g_failures = 0;
+
+#define MASK_CHECK(cond, what)                                                                        \
+    do {                                                                                              \
+        ++g_checks;                                                                                   \
+        if (!(cond)) {                                                                                \
+            ++g_failures;                                                                             \
+            fprintf(stderr, "%s:%d: %s: %s\n", __FILE__, __LINE__, #cond, std::string(what).c_str()); \
+        }                                                                                             \
+    } while (0)
+
+static std::unique_ptr<CompiledRule> Compile(const std::string& pattern) {
+    MaskRuleSpec spec;
+    spec.key = "test";
+    spec.pattern = pattern;
+    std::string error;
+    std::unique_ptr<CompiledRule> rule = CompileMaskRule(spec, &error);
+    if (rule == nullptr) fprintf(stderr, "compile %s: %s\n", pattern.c_str(), error.c_str());
+    return rule;
+}
+
+// 규칙 파일 한 줄(`키[그룹]{검증기}<근접>=패턴`)을 파싱해 컴파일합니다.
+static std::unique_ptr<CompiledRule> CompileLine(const std::string& line) {
+    std::istringstream in(line);
+    std::vector<MaskRuleSpec> rules;
+    std::string error;
+    if (!ParseMaskRules(in, &rules, &error) || rules.size() != 1) {
+        fprintf(stderr, "parse %s: %s\n", line.c_str(), error.c_str());
+        return nullptr;
+    }
+    std::unique_ptr<CompiledRule> rule = CompileMaskRule(rules[0], &error);
+    if (rule == nullptr) fprintf(stderr, "compile %s: %s\n", line.c_str(), error.c_str());
+    return rule;
+}
+
+// 플래너를 거치지 않고 DFA로 실행하는 규칙 (짧은 패턴은 플래너가 비트 병렬 NFA를 고르므로)
+static std::unique_ptr<CompiledRule> CompileDfa(const std::string& pattern) {
+    std::unique_ptr<CompiledRule> rule(new CompiledRule());
+    rule->key = "test";
+    rule->dfa.reset(new MaskDfa());
+    std::string reason;
+    if (!BuildMaskDfa(pattern, rule->dfa.get(), &reason)) return nullptr;
+    rule->plan.engine = kEngineDfa;
+    return rule;
+}
+
+// 플래너를 거치지 않고 비트 병렬 NFA로 실행하는 규칙 (위치가 kMaxBitNfaPositions를 넘으면 nullptr)
+static std::unique_ptr<CompiledRule> CompileBitNfa(const std::string& pattern) {
+    std::unique_ptr<CompiledRule> rule(new CompiledRule());
+    rule->key = "test";
+    rule->bitnfa.reset(new MaskBitNfa());
+    std::string reason;
+    if (!BuildMaskBitNfa(pattern, rule->bitnfa.get(), &reason)) return nullptr;
+    rule->plan.engine = kEngineBitNfa;
+    return rule;
+}
+
+static std::string Mask(const CompiledRule& rule, const std::string& in) {
+    std::string out(in.size(), '\0');
+    MaskInto(rule, in.data(), in.size(), '*', &out[0]);
+    return out;
+}
+
+// std::regex로 구한 leftmost-longest 결과: 가장 왼쪽 시작 위치에서 전체가 매치하는(regex_match) 가장 긴 구간을
+// 가리고 그 뒤에서 다시 찾습니다. regex_match는 모든 대안을 되짚으므로 대안 순서와 관계없이 가장 긴 매치를 찾습니다.
+static std::string ReferenceLongest(const std::regex& re, const std::string& in) {
+    std::string out = in;
+    size_t i = 0;
+    while (i < in.size()) {
+        size_t j = in.size();
+        for (; j > i; --j) {
+            if (std::regex_match(in.begin() + i, in.begin() + j, re)) break;
+        }
+        if (j == i) {
+            ++i;
+            continue;
+        }
+        for (size_t k = i; k < j; ++k) out[k] = '*';
+        i = j;
+    }
+    return out;
+}
+
+// std::regex의 ECMAScript 검색(첫 대안 우선)으로 가린 결과
+static std::string ReferenceEcmaScript(const std::regex& re, const std::string& in) {
+    std::string out = in;
+    for (std::sregex_iterator it(in.begin(), in.end(), re), last; it != last; ++it) {
+        for (size_t k = 0; k < static_cast<size_t>(it->length(0)); ++k) out[it->position(0) + k] = '*';
+    }
+    return out;
+}
+
+// DFA와 비트 병렬 NFA는 leftmost-longest로 매치합니다. 같은 규칙을 std::regex로 되짚어 구한 가장 긴 매치와 비교합니다.
+static void TestLongestMatchAgainstStdRegex() {
+    const char* patterns[] = {
+        R"(\d{4})",
+        R"(\d{3}-\d{4}-\d{4})",
+        R"(a|ab)",
+        R"(a?(?:ab)?)",
+        R"(\d{4}|\d{4}-\d{2})",
+        R"((?:ab|a)(?:bc|c)?)",
+        R"([a-c]+-?\d*)",
+        R"((?:a|b)*abb)",
+        R"(\d+(?:-\d+)*)",
+        R"([^-]{2,3}-)",
+        R"(ab{1,3}|b{2})",
+        R"(\w+@\w+\.(?:com|co\.kr))",
+    };
+    const char alphabet[] = "ab1-2c@.k ";
+    std::mt19937 rng(42);
+    for (const char* pattern : patterns) {
+        std::regex re(pattern);
+        std::unique_ptr<CompiledRule> planned = Compile(pattern);
+        std::unique_ptr<CompiledRule> dfa = CompileDfa(pattern);
+        MASK_CHECK(planned != nullptr && planned->plan.engine != kEngineRegex, pattern);
+        MASK_CHECK(dfa != nullptr, pattern);
+        if (planned == nullptr || dfa == nullptr) continue;
+        for (int round = 0; round < 300; ++round) {
+            std::string in;
+            size_t len = rng() % 24;
+            for (size_t k = 0; k < len; ++k) in += alphabet[rng() % (sizeof(alphabet) - 1)];
+            std::string expected = ReferenceLongest(re, in);
+            MASK_CHECK(Mask(*planned, in) == expected, std::string(pattern) + " on \"" + in + "\"");
+            MASK_CHECK(Mask(*dfa, in) == expected, std::string(pattern) + " (dfa) on \"" + in + "\"");
+        }
+    }
+}
+
+// ECMAScript(첫 대안 우선)와 결과가 다른 경우. README의 "엔진" 절에 적은 의도한 차이입니다.
+static void TestDifferenceFromEcmaScript() {
+    struct Case {
+        const char* pattern;
+        const char* input;
+        const char* longest;
+        const char* ecmascript;
+    };
+    const Case cases[] = {
+        {R"(a|ab)", "ab", "**", "*b"},
+        {R"(a?(?:ab)?)", "ab", "**", "*b"},
+        {R"(\d{4}|\d{4}-\d{2})", "1234-56", "*******", "****-56"},
+    };
+    for (const Case& c : cases) {
+        std::unique_ptr<CompiledRule> rule = Compile(c.pattern);
+        if (rule == nullptr) continue;
+        std::regex re(c.pattern);
+        MASK_CHECK(Mask(*rule, c.input) == c.longest, c.pattern);
+        MASK_CHECK(ReferenceEcmaScript(re, c.input) == c.ecmascript, c.pattern);
+        MASK_CHECK(ReferenceLongest(re, c.input) == c.longest, c.pattern);
+    }
+}
+
+// 규칙의 매치 중 앞뒤 bytes 바이트 안에 키워드 출현(겹치는 출현 포함)이 있는 것만 가린 결과
+static std::string ReferenceNear(const CompiledRule& plain, const std::vector<std::string>& keywords, size_t bytes,
+                                 const std::string& in) {
+    std::vector<MaskSpan> occurrences;
+    for (const std::string& keyword : keywords) {
+        for (size_t pos = in.find(keyword); pos != std::string::npos; pos = in.find(keyword, pos + 1)) {
+            occurrences.push_back({pos, keyword.size()});
+        }
+    }
+    std::string out = in;
+    ForEachMaskSpan(plain, in.data(), in.data() + in.size(), [&](size_t pos, size_t len) {
+        bool near = false;
+        for (const MaskSpan& k : occurrences) near = near || (k.pos <= pos + len + bytes && k.pos + k.len + bytes >= pos);
+        if (near) memset(&out[pos], '*', len);
+    });
+    return out;
+}
+
+// 키워드 근접 조건. 키워드 스트림은 겹치는 출현을 합친 구간이 끝날 때까지 넘기지 않으므로, 키워드가 겹쳐 길게
+// 이어지는 경우와 그런 구간이 kMaskStep 청크 경계를 넘는 경우에도 매치를 버리지 않아야 합니다.
+static void TestNearKeywords() {
+    struct Case {
+        const char* pattern;
+        std::vector<std::string> keywords;
+        size_t bytes;
+    };
+    const Case cases[] = {
+        {R"(\d{4})", {"aa"}, 5},
+        {R"(\d{4})", {"aa", "aaa", "ab"}, 3},
+        {R"(1234)", {"aba", "ba"}, 2},
+        {R"(\d+(?:-\d+)*)", {"a", "aaaa"}, 0},
+    };
+
+    {
+        MaskRuleSpec spec;
+        spec.key = "test";
+        spec.pattern = R"(\d{4})";
+        spec.near_keywords = {"aa"};
+        spec.near_bytes = 5;
+        std::string error;
+        std::unique_ptr<CompiledRule> rule = CompileMaskRule(spec, &error);
+        if (rule != nullptr) MASK_CHECK(Mask(*rule, "1234 aaaaaaaaaa") == "**** aaaaaaaaaa", "repeated keyword");
+    }
+
+    std::mt19937 rng(7);
+    for (const Case& c : cases) {
+        MaskRuleSpec spec;
+        spec.key = "test";
+        spec.pattern = c.pattern;
+        spec.near_keywords = c.keywords;
+        spec.near_bytes = c.bytes;
+        std::string error;
+        std::unique_ptr<CompiledRule> rule = CompileMaskRule(spec, &error);
+        std::unique_ptr<CompiledRule> plain = Compile(c.pattern);
+        std::unique_ptr<CompiledRule> dfa = CompileDfa(c.pattern);
+        MASK_CHECK(rule != nullptr && plain != nullptr && dfa != nullptr, c.pattern);
+        if (rule == nullptr || plain == nullptr || dfa == nullptr) continue;
+        dfa->near_keywords = MakeMaskDict(c.keywords);
+        dfa->near_bytes = c.bytes;
+
+        auto check = [&](const std::string& in, const std::string& what) {
+            std::string expected = ReferenceNear(*plain, c.keywords, c.bytes, in);
+            MASK_CHECK(Mask(*rule, in) == expected, std::string(c.pattern) + " " + what);
+            MASK_CHECK(Mask(*dfa, in) == expected, std::string(c.pattern) + " (dfa) " + what);
+        };
+        const char alphabet[] = "aab1234- ";
+        for (int round = 0; round < 300; ++round) {
+            std::string in;
+            size_t len = rng() % 32;
+            for (size_t k = 0; k < len; ++k) in += alphabet[rng() % (sizeof(alphabet) - 1)];
+            check(in, "on \"" + in + "\"");
+        }
+        // 청크 경계 앞뒤에 매치를 두고, 그 사이를 키워드가 겹쳐 이어지는 구간으로 채웁니다.
+        for (size_t run : {size_t{10}, size_t{100}, kMaskStep + 10, 3 * kMaskStep}) {
+            for (size_t at : {kMaskStep - 20, kMaskStep - 4, kMaskStep + 3}) {
+                std::string in(at, ' ');
+                in += "1234 ";
+                in += std::string(run, 'a');
+                in += " 5678 ";
+                in += std::string(run, 'b');
+                in += "9012";
+                check(in, "run " + std::to_string(run) + " at " + std::to_string(at));
+            }
+        }
+    }
+}
+
+// mask_regex()의 패턴은 쿼리에서 오므로 사전 규칙(서버 파일 읽기)과 백트래킹 패턴을 거절해야 합니다.
+static void TestMaskRegexRejects() {
+    const char* rejected[] = {"DICT:/etc/passwd", "DICT:", R"((a)\1)"};
+    for (const char* pattern : rejected) {
+        std::shared_ptr<const MaskRegexEntry> entry =
+            CompileMaskRegex(pattern, strlen(pattern), MaskPatternHash(pattern, strlen(pattern)));
+        MASK_CHECK(entry->rule == nullptr && !entry->error.empty(), pattern);
+    }
+    std::string dict_error = CompileMaskRegex("DICT:/etc/passwd", 16, 0)->error;
+    MASK_CHECK(dict_error.find(kMaskDictPrefix) != std::string::npos, dict_error);
+    MASK_CHECK(CompileMaskRegex("xDICT:", 6, 0)->rule != nullptr, "DICT: not at the start");
+}
+
+// 상수가 아닌 mask_regex() 패턴은 더 싼 단계(낮은 DFA 상태 상한, 필수 바이트 탐색 없음)로 컴파일합니다.
+static void TestMaskRegexAdHocTier() {
+    std::string large = "[ab]*a[ab]{9}c{60}";  // 위치가 63개를 넘고 DFA 상태가 1000개 남짓
+    std::shared_ptr<const MaskRegexEntry> constant =
+        CompileMaskRegex(large.data(), large.size(), 0, MaskRegexConstantLimits());
+    std::shared_ptr<const MaskRegexEntry> ad_hoc = CompileMaskRegex(large.data(), large.size(), 0);
+    MASK_CHECK(constant->rule != nullptr && constant->rule->plan.engine == kEngineDfa, large);
+    MASK_CHECK(ad_hoc->rule == nullptr && !ad_hoc->error.empty(), large);
+
+    std::string email = R"([a-z]+@corp\.com)";
+    ad_hoc = CompileMaskRegex(email.data(), email.size(), 0);
+    MASK_CHECK(ad_hoc->rule != nullptr && ad_hoc->rule->required_byte < 0, email);
+    if (ad_hoc->rule != nullptr) {
+        MASK_CHECK(Mask(*ad_hoc->rule, "to kim@corp.com now") == "to ************ now", email);
+    }
+}
+
+// 캡처 그룹 규칙은 지정한 그룹만 가리고, 겹치거나 이어진 그룹은 한 구간으로 합칩니다.
+static void TestCaptureGroups() {
+    struct Case {
+        const char* line;
+        const char* input;
+        const char* expected;
+    };
+    const Case cases[] = {
+        {R"(SSN[1]=\d{6}-(\d{7}))", "id 900101-1234567 end", "id 900101-******* end"},
+        {R"(TEL[1]=tel:(\d+))", "tel:0101234 tel:9", "tel:******* tel:*"},
+        {R"(CARD[1,3]=(\d{4})-(\d{4})-(\d{4}))", "1234-5678-9012", "****-5678-****"},
+        {R"(X[1,2]=((\d)\d)-)", "12-34-", "**-**-"},
+        {R"(Y[2]=(a)|(b))", "ab", "a*"},
+        {R"(Z[1]=(\d)\1)", "11 12", "*1 12"},
+    };
+    for (const Case& c : cases) {
+        std::unique_ptr<CompiledRule> rule = CompileLine(c.line);
+        MASK_CHECK(rule != nullptr && rule->plan.engine == kEngineRegex, c.line);
+        if (rule != nullptr) MASK_CHECK(Mask(*rule, c.input) == c.expected, c.line);
+    }
+    std::istringstream bad("BAD[2]=(a)b\n");
+    std::vector<MaskRuleSpec> rules;
+    std::string error;
+    MASK_CHECK(ParseMaskRules(bad, &rules, &error) && rules.size() == 1, "BAD[2]");
+    if (rules.size() == 1) MASK_CHECK(CompileMaskRule(rules[0], &error) == nullptr, "group 2 does not exist");
+}
+
+static SipHashKey SequentialSipKey(uint8_t first) {
+    MaskSecret secret;
+    for (int i = 0; i < 16; ++i) secret.bytes[i] = static_cast<uint8_t>(first + i);
+    return MakeSipHashKey(secret);
+}
+
+static std::string Tokenize(const SipHashKey& key, const CompiledRule& rule, const std::string& in) {
+    std::vector<MaskSpan> spans;
+    CollectMaskSpans(rule, in.data(), in.size(), &spans);
+    std::string out(TokenizedSize(in.size(), spans.data(), spans.size()), '\0');
+    char* end = WriteTokenized(key, in.data(), in.size(), spans.data(), spans.size(), &out[0]);
+    MASK_CHECK(end == &out[0] + out.size(), "tokenized size");
+    return out;
+}
+
+// SipHash-2-4 참조 벡터(키 00..0f, 메시지 00 01 02 ...)와 tokenize()의 결정성
+static void TestSipHashTokens() {
+    const uint64_t vectors[][2] = {
+        {0, 0x726fdb47dd0e0e31ull},
+        {1, 0x74f839c593dc67fdull},
+        {8, 0x93f5f5799a932462ull},
+        {15, 0xa129ca6149be45e5ull},
+    };
+    SipHashKey key = SequentialSipKey(0);
+    uint8_t message[64];
+    for (int i = 0; i < 64; ++i) message[i] = static_cast<uint8_t>(i);
+    for (const auto& v : vectors) {
+        MASK_CHECK(SipHash24(key, message, v[0]) == v[1], "siphash length " + std::to_string(v[0]));
+    }
+
+    char token[kMaskTokenLength];
+    WriteMaskToken(key, "", 0, token);
+    MASK_CHECK(std::string(token, kMaskTokenLength) == "726fdb47dd0e0e31", "empty token");
+
+    std::unique_ptr<CompiledRule> rule = Compile(R"(\d{6}-\d{7})");
+    if (rule == nullptr) return;
+    std::string a = Tokenize(key, *rule, "a 900101-1234567 b 900101-1234567");
+    std::string b = Tokenize(key, *rule, "x 900101-1234567");
+    std::string other = Tokenize(SequentialSipKey(1), *rule, "x 900101-1234567");
+    MASK_CHECK(a.size() == 2 + kMaskTokenLength + 3 + kMaskTokenLength, a);
+    MASK_CHECK(a.substr(2, kMaskTokenLength) == a.substr(5 + kMaskTokenLength), "same value, same token");
+    MASK_CHECK(b.substr(2) == a.substr(2, kMaskTokenLength), "same token across rows");
+    MASK_CHECK(other.substr(2) != b.substr(2), "different key, different token");
+    MASK_CHECK(Tokenize(key, *rule, "x 900101-1234568").substr(2) != b.substr(2), "different value, different token");
+    MASK_CHECK(Tokenize(key, *rule, "no match") == "no match", "no match");
+}
+
+static std::unique_ptr<Ff1Key> Ff1KeyFromHex(const char* hex) {
+    MaskSecret secret;
+    for (int i = 0; i < 16; ++i) {
+        secret.bytes[i] = static_cast<uint8_t>(HexValue(hex[2 * i]) * 16 + HexValue(hex[2 * i + 1]));
+    }
+    std::unique_ptr<Ff1Key> key(new Ff1Key());
+    MakeFf1Key(secret, key.get());
+    return key;
+}
+
+// FpeInto의 결과. 형식을 보존할 수 없어 NULL이 되는 행이면 ok가 false입니다.
+static std::string Fpe(const CompiledRule& rule, const Ff1Key& key, bool decrypt, const std::string& in, bool* ok) {
+    std::string out(in.size(), '\0');
+    MaskScanResult scan;
+    *ok = FpeInto(rule, in.data(), in.size(), key, decrypt, &out[0], &scan);
+    return out;
+}
+
+// FF1: NIST SP 800-38G 예제 1(radix 10, 빈 tweak)과 fpe_mask → fpe_unmask 왕복
+static void TestFf1() {
+    std::unique_ptr<Ff1Key> key = Ff1KeyFromHex("2B7E151628AED2A6ABF7158809CF4F3C");
+    std::unique_ptr<CompiledRule> digits = Compile(R"(\d+)");
+    if (digits == nullptr) return;
+    bool ok = false;
+    MASK_CHECK(Fpe(*digits, *key, false, "0123456789", &ok) == "2433477484" && ok, "SP 800-38G sample 1");
+    MASK_CHECK(Fpe(*digits, *key, true, "2433477484", &ok) == "0123456789" && ok, "SP 800-38G sample 1 decrypt");
+
+    std::unique_ptr<CompiledRule> ssn = Compile(R"(\d{6}-\d{7})");
+    std::unique_ptr<CompiledRule> mixed = Compile(R"(\d+(?:-\d+)*|[A-Z]\d+)");
+    if (ssn == nullptr || mixed == nullptr) return;
+    std::mt19937 rng(11);
+    for (int round = 0; round < 200; ++round) {
+        std::string in = "id ";
+        for (int k = 0; k < 13; ++k) in += k == 6 ? '-' : static_cast<char>('0' + rng() % 10);
+        in += " and 900101-1234567";
+        std::string masked = Fpe(*ssn, *key, false, in, &ok);
+        MASK_CHECK(ok && masked.size() == in.size() && masked[9] == '-' && masked != in, in);
+        MASK_CHECK(Fpe(*ssn, *key, true, masked, &ok) == in && ok, in);
+    }
+
+    // 6자리 미만은 '*'로 가리고 복호화에서는 그대로 둡니다. 36자리를 넘거나 영문자가 섞인 매치는 NULL입니다.
+    std::string masked = Fpe(*mixed, *key, false, "pin 1234 id 12-3456", &ok);
+    MASK_CHECK(ok && masked.substr(0, 9) == "pin **** " && masked.substr(9, 3) == "id " && masked[14] == '-', masked);
+    MASK_CHECK(Fpe(*mixed, *key, true, masked, &ok) == "pin **** id 12-3456" && ok, masked);
+    MASK_CHECK(Fpe(*mixed, *key, true, "pin 1234", &ok) == "pin 1234" && ok, "short match kept on decrypt");
+    Fpe(*mixed, *key, false, std::string(36, '7'), &ok);
+    MASK_CHECK(ok, "36 digits");
+    Fpe(*mixed, *key, false, "x " + std::string(37, '7'), &ok);
+    MASK_CHECK(!ok, "37 digits");
+    Fpe(*mixed, *key, false, "code A1234567", &ok);
+    MASK_CHECK(!ok, "letter in match");
+}
+
+// mask_cli: 청크 경계를 넘는 CSV의 선택한 열만 행 단위 MaskInto와 같게 마스킹합니다.
+static void TestMaskCli() {
+    char dir[] = "/tmp/mask_test.XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        MASK_CHECK(false, "mkdtemp");
+        return;
+    }
+    std::string input_path = std::string(dir) + "/in.csv";
+    std::string output_path = std::string(dir) + "/out.csv";
+    std::unique_ptr<CompiledRule> ssn = Compile(R"(\d{6}-\d{7})");
+    if (ssn == nullptr) return;
+
+    std::mt19937 rng(29);
+    std::string input;
+    std::string expected;
+    while (input.size() < 3 * kChunkSize) {
+        std::string ssn_field =
+            std::to_string(100000 + rng() % 900000) + "-" + std::to_string(1000000 + rng() % 9000000);
+        if (rng() % 4 == 0) ssn_field = "n/a";
+        std::string note = "tel 010-" + std::to_string(1000 + rng() % 9000) + " 900101-1234567";
+        input += "user" + std::to_string(rng() % 1000) + "," + ssn_field + "," + note + "\n";
+    }
+    input += "last,900101-1234567,no newline";
+    std::istringstream lines(input);
+    std::string line;
+    bool first = true;
+    while (std::getline(lines, line)) {
+        if (!first) expected += '\n';
+        first = false;
+        size_t a = line.find(',');
+        size_t b = line.find(',', a + 1);
+        expected += line.substr(0, a + 1) + Mask(*ssn, line.substr(a + 1, b - a - 1)) + line.substr(b);
+    }
+    std::ofstream(input_path, std::ios::binary) << input;
+
+    std::string rules_path = std::string(dir) + "/missing_rules.txt";  // 없으면 기본 규칙
+    const char* args[] = {"mask_cli", "--rules", rules_path.c_str(), "--format", "csv", "--columns", "2",
+                          "--threads", "3", "SSN", input_path.c_str(), output_path.c_str()};
+    int status = MaskCliMain(static_cast<int>(sizeof(args) / sizeof(args[0])), const_cast<char**>(args));
+    std::ifstream out(output_path, std::ios::binary);
+    std::string output((std::istreambuf_iterator<char>(out)), std::istreambuf_iterator<char>());
+    MASK_CHECK(status == 0, "mask_cli exit status");
+    MASK_CHECK(output == expected, "mask_cli csv column 2");
+
+    remove(input_path.c_str());
+    remove(output_path.c_str());
+    rmdir(dir);
+}
+
+// mask의 치환 함수들: 한 바이트 마스크는 제자리에 같은 길이로, UTF-8 마스크 문자는 문자 단위로 바꿉니다.
+static std::string MaskUtf8(const CompiledRule& rule, const std::string& in, const std::string& mask) {
+    std::vector<MaskSpan> spans;
+    CollectMaskSpans(rule, in.data(), in.size(), &spans);
+    std::string out(MaskUtf8Size(in.data(), in.size(), spans.data(), spans.size(), mask.size()), '\0');
+    char* end = WriteMaskUtf8(in.data(), in.size(), spans.data(), spans.size(), mask.data(), mask.size(), &out[0]);
+    MASK_CHECK(end == &out[0] + out.size(), in);
+    return out;
+}
+
+static void TestMaskWriters() {
+    std::unique_ptr<CompiledRule> rule = Compile(R"(홍길동|\d{4})");
+    if (rule == nullptr) return;
+    const std::string in = "이름 홍길동 PIN 1234.";
+    std::string out(in.size(), '\0');
+    MaskIntoWith(*rule, in.data(), in.size(), &out[0], ConstByteFill<'*'>());
+    MASK_CHECK(out == Mask(*rule, in), "ConstByteFill<'*'> == ByteFill{'*'}");
+    MASK_CHECK(out == "이름 ********* PIN ****.", out);
+    MaskIntoWith(*rule, in.data(), in.size(), &out[0], ByteFill{'#'});
+    MASK_CHECK(out == "이름 ######### PIN ####.", out);
+
+    MASK_CHECK(MaskUtf8(*rule, in, "●") == "이름 ●●● PIN ●●●●.", "UTF-8 mask per character");
+    MASK_CHECK(MaskUtf8(*rule, in, "x") == "이름 xxx PIN xxxx.", "one-byte mask through the UTF-8 writer");
+    MASK_CHECK(MaskUtf8(*rule, "none", "●") == "none", "no match");
+
+    auto single = [](const std::string& s) {
+        return IsSingleUtf8Char(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+    };
+    MASK_CHECK(single("*") && single("●") && single("é") && single("\xF0\x9F\x94\x92"), "single UTF-8 characters");
+    MASK_CHECK(!single("") && !single("**") && !single("●●") && !single("\xE2\x97") && !single("\x80"),
+               "not a single UTF-8 character");
+}
+
+// mask_batch: 엔진마다 MaskBatch가 행 단위 MaskInto와 같은 결과를 씁니다. 빈 행, 사전 필터에 걸리는 행,
+// kMaskStep보다 긴 행을 섞습니다.
+static void TestMaskBatch() {
+    struct Case {
+        const char* pattern;
+        MaskEngineKind engine;
+    };
+    const Case cases[] = {
+        {R"(secret)", kEngineLiteral},
+        {R"(\d{3}-\d{4})", kEngineBitNfa},
+        {R"(\d{6}-\d{7}|\w+@\w+\.(?:com|co\.kr)|[0-9a-f-]{64})", kEngineDfa},
+        {R"((\d)\1)", kEngineRegex},
+    };
+    const char alphabet[] = "0123456789-secrt@.comk ";
+    std::mt19937 rng(38);
+    for (const Case& c : cases) {
+        const char* pattern = c.pattern;
+        std::unique_ptr<CompiledRule> rule = Compile(pattern);
+        MASK_CHECK(rule != nullptr && rule->plan.engine == c.engine, pattern);
+        if (rule == nullptr) continue;
+        std::vector<std::string> rows;
+        for (int i = 0; i < 64; ++i) {
+            size_t len = i % 16 == 0 ? kMaskStep + rng() % (2 * kMaskStep) : rng() % 40;
+            std::string row;
+            for (size_t k = 0; k < len; ++k) row += alphabet[rng() % (sizeof(alphabet) - 1)];
+            if (i % 8 == 3) row = "no match here";
+            rows.push_back(row);
+        }
+        std::vector<MaskBytes> in;
+        std::vector<std::string> outputs;
+        for (const std::string& row : rows) {
+            in.push_back({row.data(), row.size()});
+            outputs.emplace_back(row.size(), '\0');
+        }
+        std::vector<char*> out;
+        for (std::string& o : outputs) out.push_back(&o[0]);
+        std::vector<MaskScanResult> results(rows.size());
+        MaskBatch(*rule, in.data(), out.data(), rows.size(), '*', results.data());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            std::string expected(rows[i].size(), '\0');
+            MaskScanResult single = MaskInto(*rule, rows[i].data(), rows[i].size(), '*', &expected[0]);
+            MASK_CHECK(outputs[i] == expected, std::string(pattern) + " row " + std::to_string(i));
+            MASK_CHECK(results[i].matches == single.matches && results[i].prefiltered == single.prefiltered,
+                       std::string(pattern) + " row " + std::to_string(i));
+        }
+    }
+}
+
+// 길이가 바뀌는 결과: MaskUtf8Size와 TokenizedSize로 미리 구한 크기가 실제로 쓴 바이트 수와 같고(헬퍼가 검사),
+// 내용은 '*' 마스킹 결과의 구간마다 문자 수만큼의 마스크나 토큰을 덧붙여 만든 결과와 같습니다.
+static void TestExactSizing() {
+    std::unique_ptr<CompiledRule> rule = Compile(R"(\d{3,})");
+    if (rule == nullptr) return;
+    const SipHashKey key = SequentialSipKey(0);
+    const char* pieces[] = {"1", "2", "3", "-", "a", " ", "가", "●", "é"};
+    std::mt19937 rng(39);
+    for (int round = 0; round < 300; ++round) {
+        std::string in;
+        size_t count = round % 50 == 0 ? kMaskStep : rng() % 40;
+        for (size_t k = 0; k < count; ++k) in += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+        std::string masked = Mask(*rule, in);
+        std::string utf8;
+        std::string tokens;
+        for (size_t i = 0; i < in.size();) {
+            if (masked[i] != '*') {
+                utf8 += in[i];
+                tokens += in[i];
+                ++i;
+                continue;
+            }
+            size_t j = i;
+            while (j < in.size() && masked[j] == '*') ++j;
+            for (size_t k = i; k < j; ++k) utf8 += "●";  // 구간은 숫자뿐이므로 바이트 수가 문자 수입니다
+            char token[kMaskTokenLength];
+            WriteMaskToken(key, in.data() + i, j - i, token);
+            tokens.append(token, kMaskTokenLength);
+            i = j;
+        }
+        MASK_CHECK(MaskUtf8(*rule, in, "●") == utf8, in);
+        MASK_CHECK(Tokenize(key, *rule, in) == tokens, in);
+    }
+}
+
+// 사전 규칙: 겹치는 출현을 합쳐 가리고(kMaskStep 경계를 걸치는 출현 포함), 캐시 파일로 왕복하며,
+// 손상된 표는 ValidateMaskDictImage가 거절합니다.
+static void TestMaskDict() {
+    char dir[] = "/tmp/mask_test.XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        MASK_CHECK(false, "mkdtemp");
+        return;
+    }
+    setenv("IMPALA_MASK_DICT_CACHE_DIR", dir, 1);
+    const std::vector<std::string> words = {"abc", "bcd", "cdab", "dd", "abcabc", "ca"};
+    std::string words_path = std::string(dir) + "/words.txt";
+    {
+        std::ofstream out(words_path);
+        for (const std::string& word : words) out << word << "\r\n";
+    }
+
+    std::unique_ptr<CompiledRule> rule = CompileLine("NAME=DICT:" + words_path);
+    MASK_CHECK(rule != nullptr && rule->plan.engine == kEngineDict, "DICT rule");
+    std::mt19937 rng(41);
+    for (int round = 0; rule != nullptr && round < 40; ++round) {
+        std::string in;
+        size_t len = round % 4 == 0 ? 3 * kMaskStep + rng() % 64 : rng() % 64;
+        for (size_t k = 0; k < len; ++k) in += "abcdx"[rng() % 5];
+        if (in.size() > kMaskStep + 8) in.replace(kMaskStep - 3, 6, "abcabc");
+        std::string expected = in;
+        for (const std::string& word : words) {
+            for (size_t pos = in.find(word); pos != std::string::npos; pos = in.find(word, pos + 1)) {
+                for (size_t k = 0; k < word.size(); ++k) expected[pos + k] = '*';
+            }
+        }
+        MASK_CHECK(Mask(*rule, in) == expected, "dict round " + std::to_string(round));
+    }
+    rule.reset();
+
+    // 캐시 파일: 처음 읽을 때 쓰고, 다시 매핑해도 같은 단어 목록입니다.
+    std::vector<std::string> sorted = words;
+    std::sort(sorted.begin(), sorted.end());
+    std::string error;
+    std::shared_ptr<const MaskDict> loaded = LoadMaskDict(words_path, &error);
+    MASK_CHECK(loaded != nullptr, error);
+    if (loaded == nullptr) return;
+    std::string cache_path = MaskDictCachePath(words_path, loaded->source_size, loaded->source_mtime);
+    MaskDict mapped;
+    MASK_CHECK(MapMaskDict(cache_path, loaded->source_size, loaded->source_mtime, &mapped), cache_path);
+    std::vector<std::string> listed;
+    MASK_CHECK(MaskDictWords(mapped, 100, &listed) && listed == sorted, "cache file round trip");
+    MASK_CHECK(!MapMaskDict(cache_path, loaded->source_size + 1, loaded->source_mtime, &mapped), "stale cache file");
+
+    // 손상된 표
+    std::vector<int32_t> image = BuildMaskDictImage(words, 0, 0);
+    MASK_CHECK(ValidateMaskDictImage(image.data(), image.size()), "valid image");
+    MASK_CHECK(!ValidateMaskDictImage(image.data(), image.size() - 1), "truncated image");
+    MaskDictHeader header;
+    memcpy(&header, image.data(), sizeof(header));
+    const size_t n = header.num_slots;
+    int32_t* base = image.data() + kMaskDictHeaderWords;
+    size_t deepest = 0;
+    for (size_t s = 1; s < n; ++s) {
+        if (base[n + s] >= 0 && base[4 * n + s] > base[4 * n + deepest]) deepest = s;
+    }
+    auto corrupted = [&](size_t index, int32_t value) {
+        std::vector<int32_t> copy = image;
+        copy[index] = value;
+        return !ValidateMaskDictImage(copy.data(), copy.size());
+    };
+    MASK_CHECK(corrupted(0, 0), "bad magic");
+    MASK_CHECK(corrupted(kMaskDictHeaderWords + deepest, static_cast<int32_t>(n)), "base out of range");
+    MASK_CHECK(corrupted(kMaskDictHeaderWords + n + deepest, static_cast<int32_t>(n)), "check out of range");
+    MASK_CHECK(corrupted(kMaskDictHeaderWords + 2 * n + 1, -1), "negative fail link");
+    MASK_CHECK(corrupted(kMaskDictHeaderWords + 2 * n + deepest, static_cast<int32_t>(deepest)), "fail link loop");
+    MASK_CHECK(corrupted(kMaskDictHeaderWords + 3 * n + deepest, base[4 * n + deepest] + 1), "out_len too long");
+
+    // 손상된 캐시 파일은 매핑하지 않고, LoadMaskDict는 단어 목록으로 다시 만듭니다.
+    loaded.reset();
+    {
+        std::ofstream out(cache_path, std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(sizeof(MaskDictHeader) + sizeof(int32_t));
+        const int32_t bad = -7;
+        out.write(reinterpret_cast<const char*>(&bad), sizeof(bad));
+    }
+    struct stat st;
+    stat(words_path.c_str(), &st);
+    int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    MaskDict rejected;
+    MASK_CHECK(!MapMaskDict(cache_path, static_cast<uint64_t>(st.st_size), mtime, &rejected), "corrupted cache file");
+    loaded = LoadMaskDict(words_path, &error);
+    MASK_CHECK(loaded != nullptr && MaskDictWords(*loaded, 100, &listed) && listed == sorted,
+               "rebuilt after corruption");
+    loaded.reset();
+
+    remove(cache_path.c_str());
+    remove(words_path.c_str());
+    rmdir(dir);
+    unsetenv("IMPALA_MASK_DICT_CACHE_DIR");
+}
+
+// 검증기가 있는 규칙의 fpe_mask → fpe_unmask 왕복. 검증기는 평문에만 적용하므로 암호문도 복호화되고,
+// 검증에 실패해 암호화하지 않은 값은 복호화 결과가 검증을 통과하지 못하면 그대로 남습니다.
+static std::string RandomDigits(std::mt19937& rng, size_t n) {
+    std::string digits;
+    for (size_t k = 0; k < n; ++k) digits += static_cast<char>('0' + rng() % 10);
+    return digits;
+}
+
+static void TestFpeValidated() {
+    std::unique_ptr<Ff1Key> key = Ff1KeyFromHex("2B7E151628AED2A6ABF7158809CF4F3C");
+    std::unique_ptr<CompiledRule> ssn = CompileLine(R"(SSN{rrn}=\d{6}-\d{7})");
+    std::unique_ptr<CompiledRule> card = CompileLine(R"(CARD{luhn}=\d{4}-?\d{4}-?\d{4}-?\d{4})");
+    if (ssn == nullptr || card == nullptr) return;
+    auto valid = [](const CompiledRule& rule, const std::string& s) {
+        return ValidateMaskMatch(rule.validators, s.data(), s.size());
+    };
+    std::mt19937 rng(42);
+    int kept = 0;
+    for (int round = 0; round < 200; ++round) {
+        // 마지막 숫자를 0~9로 바꿔 보며 검증을 통과하는 값과 통과하지 못하는 값을 하나씩 만듭니다.
+        std::string rrn = RandomDigits(rng, 6) + "-" + RandomDigits(rng, 7);
+        std::string number = RandomDigits(rng, 4) + "-" + RandomDigits(rng, 4) + "-" + RandomDigits(rng, 4) + "-" +
+                             RandomDigits(rng, 4);
+        for (char c = '0'; c <= '9' && !valid(*ssn, rrn); ++c) rrn.back() = c;
+        for (char c = '0'; c <= '9' && !valid(*card, number); ++c) number.back() = c;
+        std::string bad_rrn = rrn;
+        std::string bad_number = number;
+        bad_rrn.back() = static_cast<char>('0' + (rrn.back() - '0' + 1) % 10);
+        bad_number.back() = static_cast<char>('0' + (number.back() - '0' + 1) % 10);
+        MASK_CHECK(valid(*ssn, rrn) && !valid(*ssn, bad_rrn), rrn);
+        MASK_CHECK(valid(*card, number) && !valid(*card, bad_number), number);
+
+        bool ok = false;
+        std::string in = rrn + " old " + bad_rrn;
+        std::string masked = Fpe(*ssn, *key, false, in, &ok);
+        MASK_CHECK(ok && masked.compare(0, 14, rrn) != 0 && masked.substr(14) == in.substr(14), in);
+        std::string unmasked = Fpe(*ssn, *key, true, masked, &ok);
+        MASK_CHECK(ok && unmasked.compare(0, 14, rrn) == 0, in);
+        kept += unmasked == in;
+
+        in = "card " + number;
+        masked = Fpe(*card, *key, false, in, &ok);
+        MASK_CHECK(ok && masked != in && Fpe(*card, *key, true, masked, &ok) == in && ok, in);
+        in = "card " + bad_number;
+        masked = Fpe(*card, *key, false, in, &ok);
+        MASK_CHECK(ok && masked == in, "invalid card number is not encrypted: " + in);
+        kept += Fpe(*card, *key, true, masked, &ok) == in;
+    }
+    // 검증에 실패한 값을 복호화한 결과가 우연히 검증을 통과하는 비율은 약 10%입니다.
+    MASK_CHECK(kept >= 340, "values left as-is by fpe_mask stay on fpe_unmask: " + std::to_string(kept) + " of 400");
+}
+
+// 검증기: 검사 자리가 맞는 값과 한 자리만 다른 값. 구분자는 건너뛰고 숫자만 검사합니다.
+static void TestValidators() {
+    struct Case {
+        uint32_t validator;
+        const char* valid;
+        const char* invalid;
+    };
+    const Case cases[] = {
+        {kValidateRrn, "900101-1234568", "900101-1234567"},
+        {kValidateRrn, "8001011000008", "8001011000009"},
+        {kValidateLuhn, "4111-1111-1111-1111", "4111-1111-1111-1112"},
+        {kValidateLuhn, "5500 0000 0000 0004", "5500 0000 0000 0040"},
+        {kValidateDate6, "991231", "991232"},
+        {kValidateDate6, "000229-3", "000230-3"},
+        {kValidateDate6, "750131", "751301"},
+    };
+    for (const Case& c : cases) {
+        MASK_CHECK(ValidateMaskMatch(c.validator, c.valid, std::strlen(c.valid)), c.valid);
+        MASK_CHECK(!ValidateMaskMatch(c.validator, c.invalid, std::strlen(c.invalid)), c.invalid);
+    }
+    MASK_CHECK(!ValidateMaskMatch(kValidateLuhn, "79927398713", 11), "luhn needs 12 to 19 digits");
+    MASK_CHECK(ValidateMaskMatch(kValidateRrn, "901301-1234565", 14), "rrn alone");
+    MASK_CHECK(!ValidateMaskMatch(kValidateRrn | kValidateDate6, "901301-1234565", 14), "both validators must pass");
+
+    std::unique_ptr<CompiledRule> rule = CompileLine(R"(SSN{date6,rrn}=\d{6}-\d{7})");
+    if (rule == nullptr) return;
+    MASK_CHECK(Mask(*rule, "a 900101-1234568 b 900101-1234567") == "a ************** b 900101-1234567",
+               "SSN{date6,rrn}");
+}
+
+// mask_profile: 한 번의 스캔으로 적용한 결과가 규칙을 하나씩 적용한 결과와 같습니다. 매치가 겹칠 수 없는 규칙들은
+// mask(mask(...))와 같고, 겹치는 규칙들은 규칙마다 찾은 구간 중 앞의 규칙이 차지하지 않은 것만 남긴 결과와 같습니다.
+static std::string MaskProfileOnce(const std::vector<const CompiledRule*>& rules, const std::string& in) {
+    CompiledProfile profile;
+    profile.rules = rules;
+    BuildMaskProfilePrefilter(&profile);
+    MaskProfileScanner scanner(profile);
+    std::string out(in.size(), '\0');
+    scanner.Scan(in.data(), in.size(), &out[0]);
+    for (const MaskProfileSpan& span : scanner.spans()) memset(&out[span.pos], '*', span.len);
+    return out;
+}
+
+static void TestMaskProfile() {
+    struct Case {
+        std::vector<const char*> lines;
+        bool disjoint;  // 규칙끼리 매치가 겹칠 수 없음
+        const char* alphabet;
+    };
+    const Case cases[] = {
+        {{R"(SSN=\d{6}-\d{7})", R"(NAME=Kim|Lee|Park)", R"(KEY=secret)"}, true, "0123456789-KimLeParksecrt "},
+        {{R"(SSN{rrn}=\d{6}-\d{7})", R"(APN=\d{4})", R"(EMAIL=\w+@\w+\.com)", R"(TEL<6:tel>=\d{3}-\d{4})",
+          R"(PAIR=(\d)\1)"},
+         false, "0123456789-@.comtel "},
+    };
+    std::mt19937 rng(44);
+    for (const Case& c : cases) {
+        std::vector<std::unique_ptr<CompiledRule>> owned;
+        std::vector<const CompiledRule*> rules;
+        for (const char* line : c.lines) {
+            owned.push_back(CompileLine(line));
+            MASK_CHECK(owned.back() != nullptr, line);
+            if (owned.back() == nullptr) return;
+            rules.push_back(owned.back().get());
+        }
+        size_t alphabet_size = std::strlen(c.alphabet);
+        for (int round = 0; round < 300; ++round) {
+            std::string in;
+            size_t len = round % 50 == 0 ? 2 * kMaskStep + rng() % 64 : rng() % 80;
+            for (size_t k = 0; k < len; ++k) in += c.alphabet[rng() % alphabet_size];
+            std::string expected = in;
+            if (c.disjoint) {
+                for (const CompiledRule* rule : rules) expected = Mask(*rule, expected);
+            } else {
+                std::vector<bool> taken(in.size(), false);
+                for (const CompiledRule* rule : rules) {
+                    std::vector<MaskSpan> spans;
+                    CollectMaskSpans(*rule, in.data(), in.size(), &spans);
+                    for (const MaskSpan& span : spans) {
+                        bool free = true;
+                        for (size_t k = span.pos; k < span.pos + span.len; ++k) free = free && !taken[k];
+                        if (!free) continue;
+                        for (size_t k = span.pos; k < span.pos + span.len; ++k) taken[k] = true;
+                    }
+                }
+                for (size_t k = 0; k < in.size(); ++k) {
+                    if (taken[k]) expected[k] = '*';
+                }
+            }
+            MASK_CHECK(MaskProfileOnce(rules, in) == expected, c.lines[0] + std::string(" ... on \"") + in + "\"");
+        }
+    }
+}
+
+// 비트 병렬 NFA와 DFA: 무작위 패턴마다 두 엔진의 결과가 같습니다. 실패 경로 기록(memo)과 SIMD 첫 바이트 검색을
+// 끈 경우와 kMaskStep을 넘는 입력도 비교합니다.
+static std::string RandomPattern(std::mt19937& rng, int depth) {
+    const char* atoms[] = {"a", "b", "c", "-", "[ab]", "[^c]", R"(\d)", "1"};
+    const char* quantifiers[] = {"", "", "", "?", "*", "+", "{1,3}", "{2}"};
+    std::string pattern;
+    int pieces = 1 + static_cast<int>(rng() % 4);
+    for (int k = 0; k < pieces; ++k) {
+        std::string piece;
+        if (depth > 0 && rng() % 4 == 0) {
+            piece = "(?:" + RandomPattern(rng, depth - 1) + "|" + RandomPattern(rng, depth - 1) + ")";
+        } else {
+            piece = atoms[rng() % (sizeof(atoms) / sizeof(atoms[0]))];
+        }
+        pattern += piece + quantifiers[rng() % (sizeof(quantifiers) / sizeof(quantifiers[0]))];
+    }
+    return pattern;
+}
+
+static void TestBitNfaAgainstDfa() {
+    const char alphabet[] = "abc-1 9";
+    std::mt19937 rng(45);
+    int compared = 0;
+    for (int p = 0; p < 300; ++p) {
+        std::string pattern = RandomPattern(rng, 2);
+        std::unique_ptr<CompiledRule> bitnfa = CompileBitNfa(pattern);
+        std::unique_ptr<CompiledRule> dfa = CompileDfa(pattern);
+        if (bitnfa == nullptr || dfa == nullptr) continue;  // 위치나 DFA 상태가 상한을 넘는 패턴
+        ++compared;
+        MaskScanOptions plain;
+        plain.memo = false;
+        plain.simd = false;
+        for (int round = 0; round < 20; ++round) {
+            std::string in;
+            size_t len = round == 0 ? kMaskStep + rng() % kMaskStep : rng() % 48;
+            for (size_t k = 0; k < len; ++k) in += alphabet[rng() % (sizeof(alphabet) - 1)];
+            std::string expected = Mask(*dfa, in);
+            MASK_CHECK(Mask(*bitnfa, in) == expected, pattern + " on \"" + in + "\"");
+            std::string out(in.size(), '\0');
+            MaskIntoWith(*bitnfa, in.data(), in.size(), &out[0], ByteFill{'*'}, plain);
+            MASK_CHECK(out == expected, pattern + " (no memo, no simd) on \"" + in + "\"");
+            MaskIntoWith(*dfa, in.data(), in.size(), &out[0], ByteFill{'*'}, plain);
+            MASK_CHECK(out == expected, pattern + " (dfa, no memo, no simd) on \"" + in + "\"");
+        }
+    }
+    MASK_CHECK(compared >= 250, "patterns compared: " + std::to_string(compared));
+}
+
+// 바이트 클래스와 미리 곱한 상태 번호: 내장 표는 같은 패턴을 지금 컴파일한 표와 같고, 전이는 모두 어떤 행의
+// 시작을 가리킵니다. 256바이트 전체를 쓰는 입력에서 DFA의 결과는 바이트마다 비트 마스크를 두는 비트 병렬 NFA와
+// 같습니다.
+static void TestDfaTables() {
+    for (const MaskBuiltinDfa& builtin : kMaskBuiltinDfas) {
+        MaskDfa dfa;
+        std::string reason;
+        MASK_CHECK(BuildMaskDfa(builtin.pattern, &dfa, &reason), builtin.pattern);
+        MASK_CHECK(dfa.num_states == builtin.num_states && dfa.num_classes == builtin.num_classes &&
+                       dfa.stride_shift == builtin.stride_shift && dfa.start == builtin.start &&
+                       dfa.accept_from == builtin.accept_from,
+                   builtin.pattern);
+        MASK_CHECK(memcmp(dfa.classes, builtin.classes, 256) == 0, builtin.pattern);
+        MASK_CHECK(memcmp(dfa.next, builtin.next, dfa.TableBytes()) == 0, builtin.pattern);
+        MASK_CHECK(reinterpret_cast<uintptr_t>(builtin.next) % 64 == 0, builtin.pattern);
+    }
+
+    const char* patterns[] = {
+        R"([^a]{2}b)",
+        R"(\w+@\w+)",
+        R"([^a-z0-9 ]+1)",
+        R"((?:[a-f]|[0-9]){3}[^0-9a-f])",
+        R"(\d{6}-\d{7})",
+        R"([a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,})",
+    };
+    std::mt19937 rng(48);
+    for (const char* pattern : patterns) {
+        std::unique_ptr<CompiledRule> dfa = CompileDfa(pattern);
+        MASK_CHECK(dfa != nullptr, pattern);
+        if (dfa == nullptr) continue;
+        const MaskDfa& d = *dfa->dfa;
+        const int32_t stride = 1 << d.stride_shift;
+        MASK_CHECK(d.num_classes <= stride && reinterpret_cast<uintptr_t>(d.next) % 64 == 0, pattern);
+        bool rows = true;
+        for (int32_t s = 0; s < (d.num_states << d.stride_shift); s += stride) {
+            for (int k = 0; k < d.num_classes; ++k) {
+                int32_t t = d.next[s + k];
+                rows = rows && t >= 0 && t % stride == 0 && t < (d.num_states << d.stride_shift);
+            }
+        }
+        bool classes = true;
+        for (int b = 0; b < 256; ++b) classes = classes && d.classes[b] < d.num_classes;
+        MASK_CHECK(rows && classes, pattern);
+        MASK_CHECK(d.Step(0, 'a') == 0 && !d.Accepts(0) && d.Accepts(d.accept_from), pattern);
+
+        std::unique_ptr<CompiledRule> bitnfa = CompileBitNfa(pattern);
+        std::unique_ptr<CompiledRule> planned = Compile(pattern);
+        for (int round = 0; round < 200; ++round) {
+            std::string in;
+            size_t len = round == 0 ? kMaskStep + rng() % kMaskStep : rng() % 64;
+            for (size_t k = 0; k < len; ++k) {
+                // 절반은 패턴에 나오는 바이트, 절반은 임의의 바이트
+                in += rng() % 2 == 0 ? static_cast<char>(rng() % 256) : "ab1f@.-xZ9"[rng() % 10];
+            }
+            std::string expected = Mask(*dfa, in);
+            if (bitnfa != nullptr) MASK_CHECK(Mask(*bitnfa, in) == expected, pattern);
+            if (planned != nullptr) MASK_CHECK(Mask(*planned, in) == expected, pattern);
+        }
+    }
+}
+
+// SIMD 커널: IMPALA_MASK_ISA로 강제한 변형마다 바이트 집합 검색과 리터럴 집합 검색(Teddy)이 스칼라 구현과 같은
+// 위치를 찾습니다. 정렬과 꼬리 처리를 보도록 모든 시작 위치에서 비교합니다.
+static void TestSimdKernels() {
+    std::mt19937 rng(49);
+    auto random_byte = [&]() {
+        return static_cast<uint8_t>(rng() % 2 == 0 ? "abcxyz019-@"[rng() % 11] : rng() % 256);
+    };
+    const char* isas[] = {"scalar", "ssse3", "avx2", "avx512"};
+    for (const char* isa : isas) {
+        setenv("IMPALA_MASK_ISA", isa, 1);
+        MaskKernels kernels = SelectMaskKernels();
+        MASK_CHECK(IsMaskIsaName(kernels.isa), isa);
+        for (int round = 0; round < 60; ++round) {
+            std::vector<uint8_t> in(round % 20 == 0 ? 700 : rng() % 150);
+            for (uint8_t& b : in) b = random_byte();
+            const uint8_t* e = in.data() + in.size();
+
+            bool set[256] = {};
+            int members = round % 3 == 0 ? 1 + static_cast<int>(rng() % 3) : static_cast<int>(rng() % 60);
+            for (int k = 0; k < members; ++k) set[random_byte()] = true;
+            ByteSetFinder bytes;
+            bytes.Build(set);
+
+            std::vector<std::string> literals(1 + rng() % (round % 2 == 0 ? 4 : kMaskMaxLiterals));
+            for (std::string& literal : literals) {
+                literal.resize(1 + rng() % 5);
+                for (char& c : literal) c = static_cast<char>(random_byte());
+            }
+            LiteralSetFinder finder;
+            finder.Build(literals);
+
+            for (size_t start = 0; start <= in.size(); ++start) {
+                const uint8_t* p = in.data() + start;
+                std::string where =
+                    std::string(isa) + " round " + std::to_string(round) + " at " + std::to_string(start);
+                MASK_CHECK(kernels.find_in_set(bytes, p, e) == FindInSetScalar(bytes, p, e), where);
+                MASK_CHECK(kernels.find_literals(finder, p, e) == FindLiteralsScalar(finder, p, e), where);
+            }
+        }
+    }
+    unsetenv("IMPALA_MASK_ISA");
+}
+
+int main() {
+    TestLongestMatchAgainstStdRegex();
+    TestDifferenceFromEcmaScript();
+    TestNearKeywords();
+    TestMaskRegexRejects();
+    TestMaskRegexAdHocTier();
+    TestCaptureGroups();
+    TestSipHashTokens();
+    TestFf1();
+    TestMaskCli();
+    TestMaskWriters();
+    TestMaskBatch();
+    TestExactSizing();
+    TestMaskDict();
+    TestFpeValidated();
+    TestValidators();
+    TestMaskProfile();
+    TestBitNfaAgainstDfa();
+    TestDfaTables();
+    TestSimdKernels();
+    if (g_failures != 0) {
+        fprintf(stderr, "%d of %d checks failed\n", g_failures, g_checks);
+        return 1;
+    }
+    printf("ok %d checks\n", g_checks);
+    return 0;
+}
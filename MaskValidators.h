@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+// 매치 검증기. 규칙 키 뒤에 `{rrn,date6}`처럼 붙이면 매치 전체의 숫자(구분자는 무시)가 모든 검증기를
+// 통과할 때만 마스킹합니다. 검증은 스캔 중에 매치 바이트를 그 자리에서 읽으며, 할당이나 두 번째 스캔이 없습니다.
+//
+//   rrn    주민등록번호 13자리와 검증 숫자 (2020년 10월 이후 발급 번호는 검증 숫자를 쓰지 않아 통과하지 못합니다)
+//   luhn   카드 번호 12~19자리와 Luhn 검사
+//   date6  앞 6자리가 있을 수 있는 YYMMDD 날짜
+enum MaskValidator : uint32_t {
+    kValidateRrn = 1u << 0,
+    kValidateLuhn = 1u << 1,
+    kValidateDate6 = 1u << 2,
+};
+
+// 검증에 쓰는 숫자의 최대 개수. 이보다 숫자가 많은 매치는 어느 검증기도 통과하지 못합니다.
+constexpr size_t kMaxValidatedDigits = 32;
+
+// `rrn,luhn` 형식의 검증기 목록을 파싱합니다.
+inline bool ParseMaskValidators(const std::string& text, uint32_t* validators, std::string* error) {
+    std::stringstream ss(text);
+    std::string item;
+    *validators = 0;
+    while (std::getline(ss, item, ',')) {
+        if (item == "rrn") {
+            *validators |= kValidateRrn;
+        } else if (item == "luhn") {
+            *validators |= kValidateLuhn;
+        } else if (item == "date6") {
+            *validators |= kValidateDate6;
+        } else {
+            *error = "unknown validator '" + item + "'";
+            return false;
+        }
+    }
+    if (*validators == 0) {
+        *error = "empty validator list";
+        return false;
+    }
+    return true;
+}
+
+inline bool ValidRrnDigits(const uint8_t* d, size_t n) {
+    static const int kWeights[12] = {2, 3, 4, 5, 6, 7, 8, 9, 2, 3, 4, 5};
+    if (n != 13) return false;
+    int sum = 0;
+    for (int i = 0; i < 12; ++i) sum += d[i] * kWeights[i];
+    return (11 - sum % 11) % 10 == d[12];
+}
+
+inline bool ValidLuhnDigits(const uint8_t* d, size_t n) {
+    if (n < 12 || n > 19) return false;
+    int sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int v = d[n - 1 - i];
+        if (i % 2 == 1) {
+            v *= 2;
+            if (v > 9) v -= 9;
+        }
+        sum += v;
+    }
+    return sum % 10 == 0;
+}
+
+// 연도를 알 수 없으므로 2월은 29일까지 허용합니다.
+inline bool ValidDate6Digits(const uint8_t* d, size_t n) {
+    static const int kDays[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (n < 6) return false;
+    int month = d[2] * 10 + d[3];
+    int day = d[4] * 10 + d[5];
+    return month >= 1 && month <= 12 && day >= 1 && day <= kDays[month - 1];
+}
+
+// 매치 [p, p + len)이 validators의 모든 검증기를 통과하는지 검사합니다.
+inline bool ValidateMaskMatch(uint32_t validators, const char* p, size_t len) {
+    uint8_t digits[kMaxValidatedDigits];
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned c = static_cast<unsigned char>(p[i]) - '0';
+        if (c > 9) continue;
+        if (n == kMaxValidatedDigits) return false;
+        digits[n++] = static_cast<uint8_t>(c);
+    }
+    if ((validators & kValidateRrn) && !ValidRrnDigits(digits, n)) return false;
+    if ((validators & kValidateLuhn) && !ValidLuhnDigits(digits, n)) return false;
+    if ((validators & kValidateDate6) && !ValidDate6Digits(digits, n)) return false;
+    return true;
+}
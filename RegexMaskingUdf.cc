@@ -1,71 +1,459 @@
+#include <atomic>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <regex>
 #include <mutex>
 #include <memory> // for std::unique_ptr
 #include "impala_udf/udf.h"
+#include "MaskAdaptive.h"
+#include "MaskEngine.h"
+#include "MaskMetrics.h"
+#include "MaskProfile.h"
+#include "MaskRegexCache.h"
+#include "MaskSlowLog.h"
+#include "MaskStats.h"
 
 using namespace impala_udf;
 
+// mask()의 치환 함수. MaskPrepare에서 상수 인자 mask_val을 보고 한 번만 고르고, 행마다 이 포인터로 호출합니다.
+// options는 스레드의 적응 제어가 정한 스캔 기능입니다.
+typedef StringVal (*MaskWriter)(FunctionContext* context, const CompiledRule& rule, const StringVal& input,
+                                const StringVal& mask_val, const MaskScanOptions& options, MaskScanResult* scan);
+
 // 1. UDF의 상태를 관리할 구조체 정의
-//    정규식 패턴과 컴파일된 정규식 캐시, 그리고 스레드 동기화를 위한 뮤텍스를 포함합니다.
+//    규칙 파일에서 읽은 규칙과 컴파일된 정규식 캐시, 그리고 스레드 동기화를 위한 뮤텍스를 포함합니다.
 struct MaskState {
     std::mutex mtx;
-    std::unordered_map<std::string, std::string> patterns;
-    std::unordered_map<std::string, std::unique_ptr<std::regex>> regex_cache;
 
-    // 생성자: UDF가 사용할 정규식 패턴들을 미리 정의합니다.
-    MaskState() {
-        patterns["APN"] = R"(\d{4})";
-        patterns["EMAIL"] = R"([a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,})";
-        patterns["SSN"] = R"(\d{6}-\d{7})";
+    // 규칙 파일의 규칙. 규칙 id는 이 목록의 인덱스이며, 키는 완전 해시(rule_index)로 id에 대응시킵니다.
+    std::vector<MaskRuleSpec> rules;
+    MaskRuleIndex rule_index;
+
+    // 규칙 id별 컴파일된 규칙. 처음 쓰일 때 mtx 아래에서 컴파일해 compiled에 두고 published로 공개하므로,
+    // 그 뒤의 조회는 잠그지 않습니다.
+    std::vector<std::unique_ptr<CompiledRule>> compiled;
+    std::vector<std::atomic<const CompiledRule*>> published;
+    // 컴파일에 실패한 규칙의 원인. compile_errors를 쓴 뒤 failed로 공개하므로, 실패한 규칙은 행마다 다시 컴파일하거나
+    // 잠그지 않고 저장한 원인을 바로 돌려줍니다.
+    std::vector<std::string> compile_errors;
+    std::vector<std::atomic<bool>> failed;
+
+    // 키 인자가 상수이면 Prepare에서 찾아 둔 규칙 id. 상수가 아니거나 알 수 없는 키이면 -1
+    int constant_rule = -1;
+
+    // 규칙 파일의 프로파일. 규칙처럼 이름을 완전 해시로 찾고, 처음 쓰일 때 만들어 잠금 없이 공개합니다.
+    // 프로파일 p의 카운터 id는 rules.size() + p입니다.
+    std::vector<MaskProfileSpec> profiles;
+    MaskRuleIndex profile_index;
+    std::vector<std::unique_ptr<CompiledProfile>> compiled_profiles;
+    std::vector<std::atomic<const CompiledProfile*>> published_profiles;
+    int constant_profile = -1;
+
+    // tokenize()용 SipHash 키. TokenizePrepare에서 키 파일을 읽어 한 번만 설정합니다.
+    bool has_token_key = false;
+    SipHashKey token_key{0, 0};
+
+    // fpe_mask()/fpe_unmask()용 FF1 키 스케줄. FpePrepare에서 한 번만 계산합니다.
+    bool has_fpe_key = false;
+    Ff1Key fpe_key;
+
+    // mask()의 치환 함수 (MaskPrepare에서 설정)
+    MaskWriter mask_writer = nullptr;
+
+    // mask_regex()의 카운터 id (규칙과 프로파일 id 다음). MaskRegexPrepare를 거치지 않았으면 -1
+    int regex_id = -1;
+    // mask_regex()의 패턴 인자가 상수이면 MaskRegexPrepare에서 컴파일해 둔 항목. 아니면 nullptr
+    std::shared_ptr<const MaskRegexEntry> constant_regex;
+    // 경고를 남긴 거절된 mask_regex() 패턴 (mtx로 보호). kMaskRegexMaxWarnings개가 차면 더 남기지 않습니다.
+    std::unordered_set<std::string> regex_warned;
+    bool regex_warned_capped = false;
+
+    // 끝난 스레드들의 규칙별 카운터와 지연 시간 히스토그램 합계 (mtx로 보호)
+    MaskCounterTable totals;
+    MaskLatencyTable latency_totals;
+};
+
+// 스레드별 상태: 행마다 갱신하는 규칙별 카운터와 샘플링한 지연 시간을 잠금 없이 셉니다.
+//    THREAD_LOCAL Close에서 MaskState의 합계에 더해집니다.
+struct MaskThreadState {
+    MaskCounterTable counters;
+
+    // IMPALA_MASK_SAMPLE: sample_every번째 행마다 한 번 시간을 잽니다. 0이면 샘플링하지 않습니다.
+    uint64_t sample_every = MaskSampleEvery();
+    uint64_t sample_countdown = sample_every;
+    MaskLatencyTable latency;
+
+    // IMPALA_MASK_SLOW_US: 이보다 오래 걸린 행을 느린 행 로그에 남깁니다. 0이면 끕니다.
+    //    기록은 스레드마다 1초에 kSlowRowsPerSecond개로 제한합니다.
+    uint64_t slow_threshold_ns = MaskSlowThresholdNs();
+    uint64_t slow_window_start_ns = 0;
+    uint64_t slow_window_rows = 0;
+
+    // IMPALA_MASK_ADAPT: 규칙별로 사전 필터, 실패 경로 기록, SIMD 검색을 관찰한 통계에 따라 끄고 켭니다.
+    bool adapt = MaskAdaptEnabled();
+    MaskAdaptiveTable adaptive;
+
+    // 길이가 바뀌는 치환에서 마스킹 구간을 모으는 버퍼. 행마다 힙 할당을 하지 않도록 재사용합니다.
+    std::vector<MaskSpan> spans;
+
+    // 프로파일별 스캐너 (프로파일 번호로 인덱싱, 처음 쓰일 때 만듦). 레인의 스트림과 버퍼를 행마다 재사용합니다.
+    std::vector<std::unique_ptr<MaskProfileScanner>> profile_scanners;
+
+    // mask_regex()의 상수가 아닌 패턴을 잠금 없이 찾는 프런트 캐시 (MaskRegexCache.h)
+    MaskRegexFront regex_front;
+    // 이 스레드가 마지막으로 경고를 확인한 거절된 패턴. 같은 패턴이 이어지는 행에서는 잠그지 않습니다.
+    std::string regex_warned_last;
+
+    bool ShouldSample() {
+        if (sample_every == 0 || --sample_countdown != 0) return false;
+        sample_countdown = sample_every;
+        return true;
+    }
+
+    bool AllowSlowRow(uint64_t now_ns) {
+        if (now_ns - slow_window_start_ns >= 1000000000ull) {
+            slow_window_start_ns = now_ns;
+            slow_window_rows = 0;
+        }
+        return slow_window_rows++ < kSlowRowsPerSecond;
     }
 };
 
+// 규칙 파일을 읽어 새 MaskState를 만듭니다. 실패하면 context에 에러를 설정하고 nullptr을 반환합니다.
+MaskState* CreateMaskState(FunctionContext* context) {
+    // regex_rules.txt에서 규칙을 읽습니다. 파일이 없으면 기본 규칙(APN, EMAIL, SSN)을 사용합니다.
+    std::vector<MaskRuleSpec> specs;
+    std::vector<MaskProfileSpec> profiles;
+    std::string error;
+    if (!LoadMaskRules(MaskRulesPath(), &specs, &error, &profiles)) {
+        context->SetError(error.c_str());
+        return nullptr;
+    }
+
+    // MaskState 객체를 힙(heap)에 생성합니다.
+    DedupMaskRules(&specs);
+    MaskState* state = new MaskState();
+    state->rules = std::move(specs);
+    state->rule_index.Build(state->rules);
+    state->compiled.resize(state->rules.size());
+    state->published = std::vector<std::atomic<const CompiledRule*>>(state->rules.size());
+    state->compile_errors.resize(state->rules.size());
+    state->failed = std::vector<std::atomic<bool>>(state->rules.size());
+    std::vector<std::string> profile_names;
+    for (const MaskProfileSpec& profile : profiles) profile_names.push_back(profile.name);
+    state->profiles = std::move(profiles);
+    state->profile_index.Build(std::move(profile_names));
+    state->compiled_profiles.resize(state->profiles.size());
+    state->published_profiles = std::vector<std::atomic<const CompiledProfile*>>(state->profiles.size());
+
+    // 키 인자(첫 번째)가 상수이면 행마다 찾지 않도록 여기서 규칙 id(mask_profile이면 프로파일 번호)를 정해 둡니다.
+    if (context->IsArgConstant(0)) {
+        StringVal* key = reinterpret_cast<StringVal*>(context->GetConstantArg(0));
+        if (key != nullptr && !key->is_null) {
+            const char* name = reinterpret_cast<const char*>(key->ptr);
+            state->constant_rule = state->rule_index.Find(name, key->len);
+            state->constant_profile = state->profile_index.Find(name, key->len);
+        }
+    }
+    return state;
+}
+
+// 헬퍼 함수: StringVal을 생성합니다. (수정 없음)
+StringVal MakeStringVal(FunctionContext* context, const std::string& s) {
+    if (s.empty()) {
+        uint8_t* empty_buf = context->Allocate(0);
+        return StringVal(empty_buf, 0);
+    }
+    uint8_t* buffer = context->Allocate(s.size());
+    if (buffer == nullptr) return StringVal::null();
+    memcpy(buffer, s.data(), s.size());
+    return StringVal(buffer, s.size());
+}
+
+// 헬퍼 함수: 현재 스레드의 상태(카운터, 구간 버퍼)를 가져옵니다.
+MaskThreadState* GetThreadState(FunctionContext* context) {
+    return reinterpret_cast<MaskThreadState*>(context->GetFunctionState(FunctionContext::THREAD_LOCAL));
+}
+
+// 헬퍼 함수: 스레드의 구간 버퍼를 비워서 돌려줍니다. 스레드 상태가 없으면 local을 씁니다.
+std::vector<MaskSpan>& SpanScratch(MaskThreadState* thread, std::vector<MaskSpan>* local) {
+    std::vector<MaskSpan>& spans = thread != nullptr ? thread->spans : *local;
+    spans.clear();
+    return spans;
+}
+
+// 헬퍼 함수: 크기를 미리 계산한 결과를 한 번만 할당하고 write(out)으로 채웁니다.
+template <typename Write>
+StringVal AllocateResult(FunctionContext* context, size_t size, Write write) {
+    if (size > static_cast<size_t>(StringVal::MAX_LENGTH)) {
+        context->SetError("Masked result is too large.");
+        return StringVal::null();
+    }
+    uint8_t* buffer = context->Allocate(static_cast<int>(size));
+    if (buffer == nullptr && size != 0) return StringVal::null();
+    write(reinterpret_cast<char*>(buffer));
+    return StringVal(buffer, static_cast<int>(size));
+}
+
+// 치환 함수들: 길이가 그대로인 한 바이트 마스크는 결과 버퍼 하나에 바로 쓰고,
+//    멀티바이트 UTF-8 마스크는 문자 단위로 바꾸므로 구간을 먼저 모아 결과 크기를 계산한 뒤 한 번만 할당합니다.
+template <typename Fill>
+StringVal WriteMaskedBytes(FunctionContext* context, const CompiledRule& rule, const StringVal& input, Fill fill,
+                           const MaskScanOptions& options, MaskScanResult* scan) {
+    uint8_t* buffer = context->Allocate(input.len);
+    if (buffer == nullptr && input.len != 0) return StringVal::null();
+    *scan = MaskIntoWith(rule, reinterpret_cast<const char*>(input.ptr), input.len, reinterpret_cast<char*>(buffer),
+                         fill, options);
+    return StringVal(buffer, input.len);
+}
+
+// 가장 흔한 상수 마스크 문자('*')는 채우는 값까지 컴파일 시점에 정해 둡니다.
+template <char C>
+StringVal MaskWriteConstByte(FunctionContext* context, const CompiledRule& rule, const StringVal& input,
+                             const StringVal& /*mask_val*/, const MaskScanOptions& options, MaskScanResult* scan) {
+    return WriteMaskedBytes(context, rule, input, ConstByteFill<C>(), options, scan);
+}
+
+StringVal MaskWriteByte(FunctionContext* context, const CompiledRule& rule, const StringVal& input,
+                        const StringVal& mask_val, const MaskScanOptions& options, MaskScanResult* scan) {
+    return WriteMaskedBytes(context, rule, input, ByteFill{static_cast<char>(mask_val.ptr[0])}, options, scan);
+}
+
+StringVal MaskWriteUtf8(FunctionContext* context, const CompiledRule& rule, const StringVal& input,
+                        const StringVal& mask_val, const MaskScanOptions& options, MaskScanResult* scan) {
+    const char* in = reinterpret_cast<const char*>(input.ptr);
+    const char* mask = reinterpret_cast<const char*>(mask_val.ptr);
+    std::vector<MaskSpan> local;
+    std::vector<MaskSpan>& spans = SpanScratch(GetThreadState(context), &local);
+    *scan = CollectMaskSpans(rule, in, input.len, &spans, options);
+    size_t size = MaskUtf8Size(in, input.len, spans.data(), spans.size(), mask_val.len);
+    return AllocateResult(context, size, [&](char* out) {
+        WriteMaskUtf8(in, input.len, spans.data(), spans.size(), mask, mask_val.len, out);
+    });
+}
+
+// mask_val은 한 바이트이거나 UTF-8 문자 하나여야 합니다. 그 밖의 값이면 nullptr을 반환합니다.
+MaskWriter ChooseMaskWriter(const StringVal& mask_val) {
+    if (mask_val.is_null) return nullptr;
+    if (mask_val.len == 1) return mask_val.ptr[0] == '*' ? MaskWriteConstByte<'*'> : MaskWriteByte;
+    if (IsSingleUtf8Char(mask_val.ptr, mask_val.len)) return MaskWriteUtf8;
+    return nullptr;
+}
+
+// mask_val이 상수가 아닐 때: 행마다 고릅니다.
+StringVal MaskWriteAny(FunctionContext* context, const CompiledRule& rule, const StringVal& input,
+                       const StringVal& mask_val, const MaskScanOptions& options, MaskScanResult* scan) {
+    MaskWriter writer = ChooseMaskWriter(mask_val);
+    if (writer == nullptr) return StringVal::null();
+    return writer(context, rule, input, mask_val, options, scan);
+}
+
+// mask_val이 잘못된 상수일 때: 항상 NULL입니다.
+StringVal MaskWriteNull(FunctionContext* /*context*/, const CompiledRule& /*rule*/, const StringVal& /*input*/,
+                        const StringVal& /*mask_val*/, const MaskScanOptions& /*options*/, MaskScanResult* /*scan*/) {
+    return StringVal::null();
+}
+
 // 2. Prepare 함수 구현
 //    UDF가 실행되기 전, 상태(State)를 초기화하고 FunctionContext에 등록합니다.
-//    이 함수는 각 Impala 노드의 실행 단위(fragment)마다 한 번만 호출됩니다.
+//    FRAGMENT_LOCAL 스코프는 각 Impala 노드의 실행 단위(fragment)마다 한 번, 이어서 THREAD_LOCAL
+//    스코프가 UDF를 실행하는 스레드마다 한 번 호출됩니다.
 void MaskPrepare(FunctionContext* context, FunctionContext::FunctionStateScope scope) {
-    // FRAGMENT_LOCAL 스코프에서만 상태를 초기화하여, 동일 프래그먼트 내의 모든 UDF 호출이
-    // 동일한 상태를 공유하도록 합니다. THREAD_LOCAL도 있지만, 이 경우엔 FRAGMENT_LOCAL이 더 효율적입니다.
-    if (scope != FunctionContext::FRAGMENT_LOCAL) return;
+    // 규칙과 정규식 캐시는 FRAGMENT_LOCAL 상태에 두어 동일 프래그먼트 내의 모든 UDF 호출이 공유하고,
+    // 행마다 갱신하는 카운터만 THREAD_LOCAL 상태에 둡니다.
+    if (scope == FunctionContext::THREAD_LOCAL) {
+        context->SetFunctionState(scope, new MaskThreadState());
+        return;
+    }
+
+    MaskState* state = CreateMaskState(context);
+    if (state == nullptr) return;
+
+    // mask_val이 상수이면 치환 함수를 여기서 한 번만 고릅니다.
+    state->mask_writer = MaskWriteAny;
+    if (context->IsArgConstant(2)) {
+        StringVal* mask_val = reinterpret_cast<StringVal*>(context->GetConstantArg(2));
+        MaskWriter writer = mask_val != nullptr ? ChooseMaskWriter(*mask_val) : nullptr;
+        state->mask_writer = writer != nullptr ? writer : MaskWriteNull;
+    }
 
-    // MaskState 객체를 힙(heap)에 생성합니다.
-    MaskState* state = new MaskState();
-    
     // 생성된 상태 객체의 포인터를 FunctionContext에 저장합니다.
     // 이렇게 저장된 포인터는 메인 UDF나 Close 함수에서 다시 꺼내 쓸 수 있습니다.
     context->SetFunctionState(scope, state);
 }
 
+// 헬퍼 함수: 프래그먼트의 규칙별 카운터를 IMPALA_MASK_STATS 설정에 따라 내보냅니다.
+//    지연 시간을 샘플링했다면 히스토그램도 함께 내보내며, 이때 대상이 없으면 쿼리 경고로 남깁니다.
+void ReportMaskStats(FunctionContext* context, MaskState* state) {
+    std::string target = MaskStatsTarget();
+    bool has_latency = !state->latency_totals.by_rule.empty();
+    if (target.empty() && !has_latency) return;
+
+    // 쓰인(컴파일된) 규칙마다 규칙 파일의 순서대로 한 줄씩 만듭니다.
+    std::vector<std::string> lines;
+    for (size_t id = 0; id < state->rules.size(); ++id) {
+        if (state->compiled[id] == nullptr) continue;
+        const std::string& key = state->rules[id].key;
+        if (!target.empty()) lines.push_back(FormatMaskCounters(key, state->totals.For(static_cast<int>(id))));
+        if (id < state->latency_totals.by_rule.size() && state->latency_totals.by_rule[id] != nullptr) {
+            FormatMaskLatency(key, *state->latency_totals.by_rule[id], &lines);
+        }
+    }
+    if (!target.empty()) {
+        for (size_t p = 0; p < state->profiles.size(); ++p) {
+            if (state->compiled_profiles[p] == nullptr) continue;
+            lines.push_back(FormatMaskCounters("@" + state->profiles[p].name,
+                                               state->totals.For(state->compiled_profiles[p]->id)));
+        }
+        if (state->regex_id >= 0) {
+            lines.push_back(FormatMaskCounters("mask_regex", state->totals.For(state->regex_id)));
+        }
+    }
+    if (target.empty()) target = "warning";
+    if (target == "warning") {
+        for (const std::string& line : lines) context->AddWarning(line.c_str());
+    } else if (!AppendMaskStatsLines(target, lines)) {
+        context->AddWarning(("cannot write mask stats to " + target).c_str());
+    }
+}
+
 // 3. Close 함수 구현
 //    UDF 실행이 완료된 후, Prepare에서 할당한 상태를 안전하게 해제합니다.
-//    이 함수도 프래그먼트마다 한 번만 호출됩니다.
+//    THREAD_LOCAL 스코프가 스레드마다 먼저 호출되고, FRAGMENT_LOCAL 스코프가 프래그먼트마다 한 번 호출됩니다.
 void MaskClose(FunctionContext* context, FunctionContext::FunctionStateScope scope) {
-    if (scope != FunctionContext::FRAGMENT_LOCAL) return;
+    if (scope == FunctionContext::THREAD_LOCAL) {
+        // 스레드의 카운터와 히스토그램을 프래그먼트 합계에 더한 뒤 스레드 상태를 해제합니다.
+        MaskThreadState* thread = reinterpret_cast<MaskThreadState*>(context->GetFunctionState(scope));
+        if (thread == nullptr) return;
+        MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+        if (state != nullptr) {
+            std::lock_guard<std::mutex> lock(state->mtx);
+            state->totals.Add(thread->counters);
+            state->latency_totals.Add(thread->latency);
+        }
+        delete thread;
+        context->SetFunctionState(scope, nullptr);
+        return;
+    }
 
     // context에 저장해 두었던 MaskState 포인터를 가져옵니다.
     void* state_ptr = context->GetFunctionState(scope);
     
-    // 포인터가 유효하다면, 원래 타입으로 캐스팅하여 delete를 호출합니다.
+    // 포인터가 유효하다면, 카운터를 내보내고 노드 지표에 더한 뒤 원래 타입으로 캐스팅하여 delete를 호출합니다.
     // 이를 통해 MaskState 객체와 그 안의 모든 리소스(unique_ptr 등)가 안전하게 해제됩니다.
     if (state_ptr != nullptr) {
-        delete reinterpret_cast<MaskState*>(state_ptr);
+        MaskState* state = reinterpret_cast<MaskState*>(state_ptr);
+        ReportMaskStats(context, state);
+        std::vector<std::pair<std::string, MaskRuleCounters>> rule_totals;
+        for (size_t id = 0; id < state->rules.size(); ++id) {
+            if (state->compiled[id] == nullptr) continue;
+            rule_totals.emplace_back(state->rules[id].key, state->totals.For(static_cast<int>(id)));
+        }
+        for (size_t p = 0; p < state->profiles.size(); ++p) {
+            if (state->compiled_profiles[p] == nullptr) continue;
+            rule_totals.emplace_back("@" + state->profiles[p].name,
+                                     state->totals.For(state->compiled_profiles[p]->id));
+        }
+        if (state->regex_id >= 0) rule_totals.emplace_back("mask_regex", state->totals.For(state->regex_id));
+        MaskNodeMetrics::Instance().AddFragment(rule_totals);
+        delete state;
     }
 }
 
-// 헬퍼 함수: StringVal을 생성합니다. (수정 없음)
-StringVal MakeStringVal(FunctionContext* context, const std::string& s) {
-    if (s.empty()) {
-        uint8_t* empty_buf = context->Allocate(0);
-        return StringVal(empty_buf, 0);
+// 헬퍼 함수: 한 행의 처리 결과를 스레드 카운터에 기록합니다.
+//    id는 카운터 id이며, 규칙의 id가 아닌 곳(mask_regex)에 셀 때만 따로 넘깁니다.
+void CountRow(MaskThreadState* thread, int id, const MaskScanResult& scan, size_t input_len, size_t output_len) {
+    if (thread == nullptr) return;
+    MaskRuleCounters& counters = thread->counters.For(id);
+    ++counters.rows;
+    if (scan.prefiltered) ++counters.rows_skipped;
+    if (scan.matches > 0) ++counters.rows_matched;
+    counters.matches += scan.matches;
+    counters.bytes_scanned += input_len;
+    counters.bytes_allocated += output_len;
+}
+
+void CountRow(MaskThreadState* thread, const CompiledRule& rule, const MaskScanResult& scan,
+              size_t input_len, size_t output_len) {
+    CountRow(thread, rule.id, scan, input_len, output_len);
+}
+
+// 헬퍼 함수: 키에 해당하는 컴파일된 규칙을 찾습니다. 처음 쓰이는 규칙이면 컴파일해 공개합니다.
+//    알 수 없는 키이거나 컴파일에 실패하면 nullptr을 반환합니다. 실패는 규칙 id별로 기억해 다시 컴파일하지 않습니다.
+//    키 문자열을 만들거나 해시 맵을 조회하지 않고, 상수 키는 Prepare에서 찾아 둔 id를, 그 밖의 키는
+//    완전 해시로 입력 바이트를 그 자리에서 비교해 찾습니다. 컴파일된 규칙의 조회는 잠그지 않습니다.
+const CompiledRule* FindRuleById(FunctionContext* context, MaskState* state, int id) {
+    MaskThreadState* thread = GetThreadState(context);
+    const CompiledRule* pattern = state->published[id].load(std::memory_order_acquire);
+    if (pattern != nullptr) {
+        if (thread != nullptr) ++thread->counters.For(id).cache_hits;
+        return pattern;
     }
-    uint8_t* buffer = context->Allocate(s.size());
-    if (buffer == nullptr) return StringVal::null();
-    memcpy(buffer, s.data(), s.size());
-    return StringVal(buffer, s.size());
+    if (state->failed[id].load(std::memory_order_acquire)) {
+        context->SetError(state->compile_errors[id].c_str());
+        return nullptr;
+    }
+
+    // 여러 스레드가 같은 규칙을 처음 쓰더라도 mtx가 컴파일을 한 번으로 제한합니다.
+    std::lock_guard<std::mutex> lock(state->mtx);
+    if (state->compiled[id] != nullptr) return state->compiled[id].get();
+    if (state->failed[id].load(std::memory_order_relaxed)) {
+        context->SetError(state->compile_errors[id].c_str());
+        return nullptr;
+    }
+
+    const MaskRuleSpec& spec = state->rules[id];
+    std::string error;
+    uint64_t compile_start_ns = MaskNowNs();
+    auto compiled = CompileMaskRule(spec, &error);
+    if (compiled == nullptr) {
+        state->compile_errors[id] = error;
+        state->failed[id].store(true, std::memory_order_release);
+        context->SetError(error.c_str());
+        return nullptr;
+    }
+    MaskNodeMetrics::Instance().RecordCompile(spec.key, MaskNowNs() - compile_start_ns, MaskRuleMemory(*compiled));
+    compiled->id = id;
+    if (thread != nullptr) ++thread->counters.For(id).cache_misses;
+    pattern = compiled.get();
+    state->compiled[id] = std::move(compiled);
+    state->published[id].store(pattern, std::memory_order_release);
+    return pattern;
+}
+
+const CompiledRule* FindRule(FunctionContext* context, MaskState* state, const StringVal& key) {
+    int id = state->constant_rule;
+    if (id < 0) id = state->rule_index.Find(reinterpret_cast<const char*>(key.ptr), key.len);
+    if (id < 0) return nullptr;
+    return FindRuleById(context, state, id);
 }
 
+// 헬퍼 함수: 프로파일 번호에 해당하는 컴파일된 프로파일을 찾습니다. 처음 쓰이면 규칙들을 컴파일해 만듭니다.
+//    규칙 하나라도 컴파일에 실패하면 nullptr을 반환합니다.
+const CompiledProfile* FindProfileById(FunctionContext* context, MaskState* state, int p) {
+    const CompiledProfile* profile = state->published_profiles[p].load(std::memory_order_acquire);
+    if (profile != nullptr) return profile;
+
+    // 규칙은 FindRuleById가 각자 잠금 아래에서 컴파일하므로, 잠금 없이 모은 뒤 프로파일만 잠금 아래에서 공개합니다.
+    std::unique_ptr<CompiledProfile> compiled(new CompiledProfile());
+    compiled->name = state->profiles[p].name;
+    compiled->id = static_cast<int>(state->rules.size()) + p;
+    for (const std::string& key : state->profiles[p].rules) {
+        int id = state->rule_index.Find(key.data(), key.size());
+        const CompiledRule* rule = id >= 0 ? FindRuleById(context, state, id) : nullptr;
+        if (rule == nullptr) return nullptr;
+        compiled->rules.push_back(rule);
+    }
+    BuildMaskProfilePrefilter(compiled.get());
+
+    std::lock_guard<std::mutex> lock(state->mtx);
+    if (state->compiled_profiles[p] != nullptr) return state->compiled_profiles[p].get();
+    profile = compiled.get();
+    state->compiled_profiles[p] = std::move(compiled);
+    state->published_profiles[p].store(profile, std::memory_order_release);
+    return profile;
+}
 
 // 4. 메인 UDF 로직 수정
 //    이제 전역 변수 대신 FunctionContext에서 상태를 가져와 사용합니다.
@@ -74,6 +462,13 @@ StringVal mask(FunctionContext* context,
                const StringVal& input,
                const StringVal& mask_val) {
     if (key.is_null || input.is_null || mask_val.is_null) return StringVal::null();
+
+    // 샘플링이 켜져 있으면 일부 행만, 느린 행 기록이 켜져 있으면 모든 행의
+    // 규칙 조회부터 결과 반환까지의 시간을 잽니다.
+    MaskThreadState* thread = GetThreadState(context);
+    bool sampled = thread != nullptr && thread->ShouldSample();
+    bool timed = sampled || (thread != nullptr && thread->slow_threshold_ns != 0);
+    uint64_t start_ns = timed ? MaskNowNs() : 0;
     
     // FunctionContext에서 Prepare 함수가 만들어 둔 상태(State) 객체를 가져옵니다.
     MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
@@ -83,54 +478,432 @@ StringVal mask(FunctionContext* context,
         return StringVal::null(); 
     }
 
-    std::string key_str(reinterpret_cast<const char*>(key.ptr), key.len);
-    
-    const std::regex* pattern = nullptr;
-    {
-        // 스레드 안전하게 정규식 캐시를 조회하고, 없으면 컴파일 후 저장합니다.
-        // 여러 스레드가 동시에 이 UDF를 호출하더라도 mtx가 캐시 접근을 보호합니다.
-        std::lock_guard<std::mutex> lock(state->mtx);
-        auto it = state->regex_cache.find(key_str);
-        if (it != state->regex_cache.end()) {
-            pattern = it->second.get();
-        } else {
-            auto pattern_it = state->patterns.find(key_str);
-            if (pattern_it != state->patterns.end()) {
-                try {
-                    // C++14 이상에서는 std::make_unique 사용 권장
-                    auto compiled = std::unique_ptr<std::regex>(new std::regex(pattern_it->second));
-                    pattern = compiled.get();
-                    state->regex_cache[key_str] = std::move(compiled);
-                } catch (const std::regex_error& e) {
-                    context->SetError(e.what());
-                    return StringVal::null();
-                }
-            }
+    const CompiledRule* pattern = FindRule(context, state, key);
+    if (pattern == nullptr) return StringVal::null();
+
+    // 매치 전체 또는 규칙에 지정된 캡처 그룹을 mask_val로 덮어씁니다.
+    // 한 바이트 마스크는 입력을 중간 문자열로 복사하지 않고 최종 결과 버퍼 하나에 청크 단위로 쓰며,
+    // 치환 함수는 MaskPrepare에서 골라 둔 것을 사용합니다. 스캔 기능은 스레드의 적응 제어가 규칙마다 정합니다.
+    MaskAdaptive* adaptive = thread != nullptr && thread->adapt ? &thread->adaptive.For(pattern->id) : nullptr;
+    MaskScanOptions options = adaptive != nullptr ? adaptive->options() : MaskScanOptions();
+    MaskScanResult scan;
+    StringVal result = state->mask_writer(context, *pattern, input, mask_val, options, &scan);
+    if (result.is_null) return result;
+    CountRow(thread, *pattern, scan, input.len, result.len);
+    if (adaptive != nullptr) adaptive->Record(*pattern, scan, &thread->counters.For(pattern->id));
+    if (timed) {
+        uint64_t now_ns = MaskNowNs();
+        uint64_t elapsed_ns = now_ns - start_ns;
+        if (sampled) thread->latency.For(pattern->id).Record(elapsed_ns, input.len);
+        if (thread->slow_threshold_ns != 0 && elapsed_ns >= thread->slow_threshold_ns &&
+            thread->AllowSlowRow(now_ns)) {
+            MaskSlowLog::Instance().Record(pattern->key, input.ptr, input.len, scan.matches, elapsed_ns);
+        }
+    }
+    return result;
+}
+
+// 헬퍼 함수: 세 번째 상수 인자(secret_ref)가 가리키는 키 파일을 읽습니다.
+bool ReadSecretArg(FunctionContext* context, MaskSecret* secret) {
+    if (!context->IsArgConstant(2)) {
+        context->SetError("secret_ref must be a constant.");
+        return false;
+    }
+    StringVal* secret_ref = reinterpret_cast<StringVal*>(context->GetConstantArg(2));
+    if (secret_ref == nullptr || secret_ref->is_null) {
+        context->SetError("secret_ref must not be NULL.");
+        return false;
+    }
+
+    std::string error;
+    if (!LoadMaskSecret(std::string(reinterpret_cast<const char*>(secret_ref->ptr), secret_ref->len),
+                        secret, &error)) {
+        context->SetError(error.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 5. tokenize UDF의 Prepare 함수
+//    MaskPrepare와 같은 상태를 만들고, 상수 인자 secret_ref가 가리키는 키 파일을 읽어 SipHash 키를 설정합니다.
+//    키는 프래그먼트마다 한 번만 읽으므로 행마다 키를 준비하는 비용이 없습니다.
+void TokenizePrepare(FunctionContext* context, FunctionContext::FunctionStateScope scope) {
+    if (scope == FunctionContext::THREAD_LOCAL) {
+        context->SetFunctionState(scope, new MaskThreadState());
+        return;
+    }
+
+    MaskSecret secret;
+    if (!ReadSecretArg(context, &secret)) return;
+
+    MaskState* state = CreateMaskState(context);
+    if (state == nullptr) return;
+    state->token_key = MakeSipHashKey(secret);
+    state->has_token_key = true;
+    context->SetFunctionState(scope, state);
+}
+
+// 6. tokenize UDF
+//    매치 구간을 고정 길이 keyed hash 토큰으로 치환합니다. 같은 값은 항상 같은 토큰이 되므로
+//    마스킹된 식별자끼리 조인할 수 있습니다. 해제는 MaskClose를 그대로 사용합니다.
+StringVal tokenize(FunctionContext* context,
+                   const StringVal& key,
+                   const StringVal& input,
+                   const StringVal& /*secret_ref*/) {
+    if (key.is_null || input.is_null) return StringVal::null();
+
+    MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    if (state == nullptr || !state->has_token_key) {
+        context->SetError("Tokenize UDF state not prepared.");
+        return StringVal::null();
+    }
+
+    const CompiledRule* pattern = FindRule(context, state, key);
+    if (pattern == nullptr) return StringVal::null();
+
+    // 구간을 먼저 모아 토큰으로 바꾼 결과의 크기를 계산하고, 결과 버퍼를 한 번만 할당해 바로 씁니다.
+    const char* in = reinterpret_cast<const char*>(input.ptr);
+    MaskThreadState* thread = GetThreadState(context);
+    std::vector<MaskSpan> local;
+    std::vector<MaskSpan>& spans = SpanScratch(thread, &local);
+    MaskScanResult scan = CollectMaskSpans(*pattern, in, input.len, &spans);
+    size_t size = TokenizedSize(input.len, spans.data(), spans.size());
+    StringVal result = AllocateResult(context, size, [&](char* out) {
+        WriteTokenized(state->token_key, in, input.len, spans.data(), spans.size(), out);
+    });
+    if (result.is_null) return result;
+    CountRow(thread, *pattern, scan, input.len, result.len);
+    return result;
+}
+
+// 7. fpe_mask / fpe_unmask UDF의 Prepare 함수
+//    키 파일을 읽어 AES 라운드 키와 길이별 FF1 CBC-MAC 첫 블록을 프래그먼트마다 한 번만 계산합니다.
+void FpePrepare(FunctionContext* context, FunctionContext::FunctionStateScope scope) {
+    if (scope == FunctionContext::THREAD_LOCAL) {
+        context->SetFunctionState(scope, new MaskThreadState());
+        return;
+    }
+
+    MaskSecret secret;
+    if (!ReadSecretArg(context, &secret)) return;
+
+    MaskState* state = CreateMaskState(context);
+    if (state == nullptr) return;
+    MakeFf1Key(secret, &state->fpe_key);
+    state->has_fpe_key = true;
+    context->SetFunctionState(scope, state);
+}
+
+// 헬퍼 함수: fpe_mask와 fpe_unmask의 공통 본문
+StringVal FpeTransform(FunctionContext* context, const StringVal& key, const StringVal& input, bool decrypt) {
+    if (key.is_null || input.is_null) return StringVal::null();
+
+    MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    if (state == nullptr || !state->has_fpe_key) {
+        context->SetError("FPE UDF state not prepared.");
+        return StringVal::null();
+    }
+
+    const CompiledRule* pattern = FindRule(context, state, key);
+    if (pattern == nullptr) return StringVal::null();
+
+    // 형식을 보존할 수 없는 매치(숫자가 아닌 문자 포함, 36자리 초과)가 있으면 NULL을 반환합니다.
+    // 길이가 바뀌지 않으므로 결과 버퍼에 바로 씁니다.
+    uint8_t* buffer = context->Allocate(input.len);
+    if (buffer == nullptr && input.len != 0) return StringVal::null();
+    MaskScanResult scan;
+    bool ok = FpeInto(*pattern, reinterpret_cast<const char*>(input.ptr), input.len, state->fpe_key, decrypt,
+                      reinterpret_cast<char*>(buffer), &scan);
+    if (!ok) {
+        context->Free(buffer);
+        return StringVal::null();
+    }
+    CountRow(GetThreadState(context), *pattern, scan, input.len, input.len);
+    return StringVal(buffer, input.len);
+}
+
+// 8. fpe_mask UDF
+//    매치 구간의 숫자를 FF1으로 암호화합니다. 길이, 구분자, 숫자 자리는 그대로 유지됩니다.
+StringVal fpe_mask(FunctionContext* context,
+                   const StringVal& key,
+                   const StringVal& input,
+                   const StringVal& /*secret_ref*/) {
+    return FpeTransform(context, key, input, false);
+}
+
+// 9. fpe_unmask UDF
+//    fpe_mask의 역변환입니다. 같은 규칙과 키로 호출하면 원래 값을 돌려줍니다.
+StringVal fpe_unmask(FunctionContext* context,
+                     const StringVal& key,
+                     const StringVal& input,
+                     const StringVal& /*secret_ref*/) {
+    return FpeTransform(context, key, input, true);
+}
+
+// 10. mask_batch: 여러 행을 한 번에 마스킹하는 내부 배치 API
+//    Impala의 UDF 호출은 행 단위이므로 SQL에서 직접 부르지는 않고, 행을 모아 넘길 수 있는 실행 경로에서 씁니다.
+//    인자 검사와 상태, 규칙 조회는 배치마다 한 번이며, 한 바이트 마스크의 결과는 Allocate 한 번으로 잡은
+//    공유 버퍼에 차례로 씁니다. NULL 입력은 NULL 결과가 됩니다. 실패하면 false를 반환합니다.
+bool mask_batch(FunctionContext* context,
+                const StringVal& key,
+                const StringVal* in,
+                int n,
+                const StringVal& mask_val,
+                StringVal* out) {
+    for (int i = 0; i < n; ++i) out[i] = StringVal::null();
+    if (key.is_null || mask_val.is_null) return true;
+
+    MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    if (state == nullptr) {
+        context->SetError("Masking UDF state not prepared.");
+        return false;
+    }
+    const CompiledRule* pattern = FindRule(context, state, key);
+    if (pattern == nullptr) return true;
+    MaskThreadState* thread = GetThreadState(context);
+
+    // 멀티바이트 마스크는 행마다 길이가 달라지므로, 모든 행의 구간을 먼저 모아 결과 크기를 계산한 뒤
+    // 배치 전체를 한 번에 할당합니다.
+    if (mask_val.len != 1) {
+        if (!IsSingleUtf8Char(mask_val.ptr, mask_val.len)) return true;
+        const char* mask = reinterpret_cast<const char*>(mask_val.ptr);
+        std::vector<MaskSpan> local;
+        std::vector<MaskSpan>& spans = SpanScratch(thread, &local);
+        std::vector<size_t> first_span(n + 1, 0);
+        std::vector<MaskScanResult> scans(n);
+        size_t total = 0;
+        for (int i = 0; i < n; ++i) {
+            first_span[i] = spans.size();
+            if (in[i].is_null) continue;
+            const char* row = reinterpret_cast<const char*>(in[i].ptr);
+            scans[i] = CollectMaskSpans(*pattern, row, in[i].len, &spans);
+            total += MaskUtf8Size(row, in[i].len, spans.data() + first_span[i], spans.size() - first_span[i],
+                                  mask_val.len);
+        }
+        first_span[n] = spans.size();
+        if (total > static_cast<size_t>(StringVal::MAX_LENGTH)) {
+            context->SetError("mask_batch: batch too large.");
+            return false;
         }
+        uint8_t* arena = context->Allocate(static_cast<int>(total));
+        if (arena == nullptr && total != 0) return false;
+        char* dst = reinterpret_cast<char*>(arena);
+        for (int i = 0; i < n; ++i) {
+            if (in[i].is_null) continue;
+            char* end = WriteMaskUtf8(reinterpret_cast<const char*>(in[i].ptr), in[i].len,
+                                      spans.data() + first_span[i], first_span[i + 1] - first_span[i], mask,
+                                      mask_val.len, dst);
+            out[i] = StringVal(reinterpret_cast<uint8_t*>(dst), static_cast<int>(end - dst));
+            CountRow(thread, *pattern, scans[i], in[i].len, out[i].len);
+            dst = end;
+        }
+        return true;
+    }
+
+    std::vector<MaskBytes> inputs;
+    std::vector<int> rows;
+    inputs.reserve(n);
+    rows.reserve(n);
+    size_t total = 0;
+    for (int i = 0; i < n; ++i) {
+        if (in[i].is_null) continue;
+        inputs.push_back({reinterpret_cast<const char*>(in[i].ptr), static_cast<size_t>(in[i].len)});
+        rows.push_back(i);
+        total += in[i].len;
+    }
+    if (total > static_cast<size_t>(StringVal::MAX_LENGTH)) {
+        context->SetError("mask_batch: batch too large.");
+        return false;
+    }
+    uint8_t* arena = context->Allocate(static_cast<int>(total));
+    if (arena == nullptr && total != 0) return false;
+
+    std::vector<char*> outputs(inputs.size());
+    size_t offset = 0;
+    for (size_t k = 0; k < inputs.size(); ++k) {
+        outputs[k] = reinterpret_cast<char*>(arena) + offset;
+        offset += inputs[k].len;
+    }
+    std::vector<MaskScanResult> scans(inputs.size());
+    MaskBatch(*pattern, inputs.data(), outputs.data(), inputs.size(), static_cast<char>(mask_val.ptr[0]),
+              scans.data());
+    for (size_t k = 0; k < inputs.size(); ++k) {
+        out[rows[k]] = StringVal(reinterpret_cast<uint8_t*>(outputs[k]), static_cast<int>(inputs[k].len));
+        CountRow(thread, *pattern, scans[k], inputs[k].len, inputs[k].len);
+    }
+    return true;
+}
+
+// 11. mask_profile UDF의 Prepare 함수
+//    상태는 mask()와 같고, 프로파일 이름이 상수이면 여기서 프로파일의 규칙들을 미리 컴파일합니다.
+void MaskProfilePrepare(FunctionContext* context, FunctionContext::FunctionStateScope scope) {
+    MaskPrepare(context, scope);
+    if (scope != FunctionContext::FRAGMENT_LOCAL) return;
+    MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    if (state == nullptr || state->constant_profile < 0) return;
+    FindProfileById(context, state, state->constant_profile);
+}
+
+// 12. mask_profile UDF
+//    프로파일(규칙 파일의 `@이름=규칙,...`)의 모든 규칙을 입력 한 번의 스캔으로 적용하고 매치를 '*'로 덮어씁니다.
+//    서로 겹치는 매치는 프로파일에 먼저 적은 규칙의 것을 남깁니다. 결과는 한 번만 할당합니다.
+StringVal mask_profile(FunctionContext* context, const StringVal& profile_name, const StringVal& input) {
+    if (profile_name.is_null || input.is_null) return StringVal::null();
+
+    MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    if (state == nullptr) {
+        context->SetError("Masking UDF state not prepared.");
+        return StringVal::null();
+    }
+    int p = state->constant_profile;
+    if (p < 0) p = state->profile_index.Find(reinterpret_cast<const char*>(profile_name.ptr), profile_name.len);
+    if (p < 0) return StringVal::null();
+    const CompiledProfile* profile = FindProfileById(context, state, p);
+    if (profile == nullptr) return StringVal::null();
+
+    // 스캐너는 스레드마다 하나씩 두고 재사용합니다. 스레드 상태가 없으면 이 행에서만 씁니다.
+    MaskThreadState* thread = GetThreadState(context);
+    std::unique_ptr<MaskProfileScanner> local;
+    MaskProfileScanner* scanner;
+    if (thread != nullptr) {
+        if (thread->profile_scanners.size() <= static_cast<size_t>(p)) thread->profile_scanners.resize(p + 1);
+        if (thread->profile_scanners[p] == nullptr) thread->profile_scanners[p].reset(new MaskProfileScanner(*profile));
+        scanner = thread->profile_scanners[p].get();
+    } else {
+        local.reset(new MaskProfileScanner(*profile));
+        scanner = local.get();
     }
 
+    uint8_t* buffer = context->Allocate(input.len);
+    if (buffer == nullptr && input.len != 0) return StringVal::null();
+    char* out = reinterpret_cast<char*>(buffer);
+    scanner->Scan(reinterpret_cast<const char*>(input.ptr), input.len, out);
+    for (const MaskProfileSpan& span : scanner->spans()) memset(out + span.pos, '*', span.len);
+
+    if (thread != nullptr) {
+        MaskRuleCounters& counters = thread->counters.For(profile->id);
+        ++counters.rows;
+        if (scanner->AllPrefiltered()) ++counters.rows_skipped;
+        if (!scanner->spans().empty()) ++counters.rows_matched;
+        counters.matches += scanner->spans().size();
+        counters.bytes_scanned += input.len;
+        counters.bytes_allocated += input.len;
+    }
+    return StringVal(buffer, input.len);
+}
+
+// 13. explain_rule UDF의 Prepare 함수
+//    mask()와 같은 규칙 파일로 상태를 만듭니다. 규칙 키가 상수이면 여기서 규칙을 미리 컴파일합니다.
+void ExplainRulePrepare(FunctionContext* context, FunctionContext::FunctionStateScope scope) {
+    if (scope == FunctionContext::THREAD_LOCAL) return;
+    MaskState* state = CreateMaskState(context);
+    if (state == nullptr) return;
+    context->SetFunctionState(scope, state);
+    if (state->constant_rule >= 0) FindRuleById(context, state, state->constant_rule);
+}
+
+// 14. explain_rule UDF
+//    규칙을 컴파일할 때 플래너가 고른 엔진과 사전 필터, 오토마톤 크기, 그 근거를 한 줄로 돌려줍니다.
+//    알 수 없는 키이면 NULL입니다. 해제는 MaskClose를 그대로 사용합니다.
+StringVal explain_rule(FunctionContext* context, const StringVal& key) {
+    if (key.is_null) return StringVal::null();
+
+    MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    if (state == nullptr) {
+        context->SetError("Masking UDF state not prepared.");
+        return StringVal::null();
+    }
+    const CompiledRule* pattern = FindRule(context, state, key);
     if (pattern == nullptr) return StringVal::null();
+    return MakeStringVal(context, FormatMaskPlan(*pattern));
+}
 
-    std::string input_str(reinterpret_cast<const char*>(input.ptr), input.len);
-    std::string mask_str(reinterpret_cast<const char*>(mask_val.ptr), mask_val.len);
+// 15. mask_regex UDF의 Prepare 함수
+//    MaskPrepare와 같은 상태와 치환 함수(세 번째 인자 mask_char)를 만들고, 패턴 인자가 상수이면 여기서 한 번만
+//    컴파일합니다. 백트래킹이 필요하거나 잘못된 상수 패턴은 쿼리 에러입니다.
+void MaskRegexPrepare(FunctionContext* context, FunctionContext::FunctionStateScope scope) {
+    MaskPrepare(context, scope);
+    if (scope == FunctionContext::THREAD_LOCAL) return;
+    MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    if (state == nullptr) return;
+    state->regex_id = static_cast<int>(state->rules.size() + state->profiles.size());
+    if (!context->IsArgConstant(0)) return;
+    StringVal* pattern = reinterpret_cast<StringVal*>(context->GetConstantArg(0));
+    if (pattern == nullptr || pattern->is_null) return;
+    const char* p = reinterpret_cast<const char*>(pattern->ptr);
+    std::shared_ptr<const MaskRegexEntry> entry =
+        CompileMaskRegex(p, pattern->len, MaskPatternHash(p, pattern->len), MaskRegexConstantLimits());
+    if (entry->rule == nullptr) {
+        context->SetError(entry->error.c_str());
+        return;
+    }
+    state->constant_regex = std::move(entry);
+}
 
-    if (mask_str.length() != 1) return StringVal::null();
-    char mask_char = mask_str[0];
+// 헬퍼 함수: 거절된 mask_regex() 패턴의 경고를 프래그먼트에서 패턴마다 한 번만 남깁니다.
+void WarnRejectedRegex(FunctionContext* context, MaskState* state, MaskThreadState* thread,
+                       const MaskRegexEntry& entry) {
+    if (thread != nullptr) {
+        if (thread->regex_warned_last == entry.pattern) return;
+        thread->regex_warned_last = entry.pattern;
+    }
+    std::lock_guard<std::mutex> lock(state->mtx);
+    if (state->regex_warned.count(entry.pattern) != 0 || state->regex_warned_capped) return;
+    if (state->regex_warned.size() == kMaskRegexMaxWarnings) {
+        state->regex_warned_capped = true;
+        context->AddWarning("mask_regex: more rejected patterns returned NULL without a warning");
+        return;
+    }
+    state->regex_warned.insert(entry.pattern);
+    // 패턴은 앞부분만 보여 줍니다.
+    std::string shown = entry.pattern.substr(0, 64);
+    if (shown.size() < entry.pattern.size()) shown += "...";
+    context->AddWarning((entry.error + " (pattern '" + shown + "'); returning NULL").c_str());
+}
 
-    // 기존의 문자열 치환 로직 (가장 효율적인 방식으로 수정)
-    std::string result;
-    result.reserve(input_str.length()); // 미리 메모리를 할당하여 성능 향상
+// 16. mask_regex UDF
+//    규칙 파일에 없는 패턴을 인자로 받아 매치를 mask_char로 덮어씁니다. 치환은 mask()와 같습니다.
+//    상수가 아닌 패턴은 스레드의 프런트 캐시와 프로세스의 샤드 LRU(MaskRegexCache)에서 찾으며, 행마다 파싱하지
+//    않습니다. 임시 패턴은 창마다의 통계를 모을 규칙이 없으므로 적응 제어 없이 모든 스캔 기능을 켜고 실행합니다.
+StringVal mask_regex(FunctionContext* context,
+                     const StringVal& pattern,
+                     const StringVal& input,
+                     const StringVal& mask_char) {
+    if (pattern.is_null || input.is_null || mask_char.is_null) return StringVal::null();
 
-    std::sregex_iterator it(input_str.begin(), input_str.end(), *pattern);
-    std::sregex_iterator end;
-    auto last_match = input_str.cbegin();
+    MaskState* state = reinterpret_cast<MaskState*>(context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    if (state == nullptr || state->regex_id < 0) {
+        context->SetError("mask_regex UDF state not prepared.");
+        return StringVal::null();
+    }
 
-    for (; it != end; ++it) {
-        result.append(it->prefix().first, it->prefix().second);
-        result.append(it->length(), mask_char);
-        last_match = it->suffix().first;
+    MaskThreadState* thread = GetThreadState(context);
+    const MaskRegexEntry* entry = state->constant_regex.get();
+    std::shared_ptr<const MaskRegexEntry> local;
+    bool hit = entry != nullptr;
+    if (entry == nullptr) {
+        const char* p = reinterpret_cast<const char*>(pattern.ptr);
+        if (thread != nullptr) {
+            entry = thread->regex_front.Find(p, pattern.len, &hit);
+        } else {
+            local = MaskRegexCache::Instance().Find(p, pattern.len, MaskPatternHash(p, pattern.len));
+            entry = local.get();
+        }
+    }
+    if (entry->rule == nullptr) {
+        // 상수 패턴의 거절은 MaskRegexPrepare에서 에러가 됩니다. 행마다 다른 패턴은 한 행 때문에 쿼리 전체를
+        // 멈추지 않도록 NULL을 반환하고 경고만 남깁니다.
+        WarnRejectedRegex(context, state, thread, *entry);
+        return StringVal::null();
     }
-    result.append(last_match, input_str.cend());
 
-    return MakeStringVal(context, result);
+    MaskScanResult scan;
+    StringVal result = state->mask_writer(context, *entry->rule, input, mask_char, MaskScanOptions(), &scan);
+    if (result.is_null) return result;
+    CountRow(thread, state->regex_id, scan, input.len, result.len);
+    if (thread != nullptr) {
+        MaskRuleCounters& counters = thread->counters.For(state->regex_id);
+        ++(hit ? counters.cache_hits : counters.cache_misses);
+    }
+    return result;
 }